@@ -0,0 +1,203 @@
+#ifndef Analytic_cpp
+#define Analytic_cpp
+
+#include "Analytic.h"
+
+// ** Polygon helpers **
+// Points of the projection plane; polygons are counterclockwise and at most ANALYTIC_MAX_VERTICES long
+struct Point2 {
+    double x, y;
+};
+
+static double cross2(const Point2& o, const Point2& a, const Point2& b) {
+    return (a.x - o.x) * (b.y - o.y) - (a.y - o.y) * (b.x - o.x);
+}
+
+static double getPolygonArea(const Point2* polygon, int n) {
+    double area = 0;
+    for (int i = 0; i < n; i++) {
+        const Point2& a = polygon[i];
+        const Point2& b = polygon[(i + 1) % n];
+        area += a.x * b.y - b.x * a.y;
+    }
+    return area / 2;
+}
+
+// Convex hull of the points (monotone chain); returns its number of vertices
+static int getConvexHull(Point2* points, int n, Point2* hull) {
+    // Insertion sort by x then y; there are at most 14 points
+    for (int i = 1; i < n; i++) {
+        Point2 p = points[i];
+        int j = i - 1;
+        while (j >= 0 && (points[j].x > p.x || (points[j].x == p.x && points[j].y > p.y))) {
+            points[j + 1] = points[j];
+            j--;
+        }
+        points[j + 1] = p;
+    }
+    if (n < 3) {
+        return 0;
+    }
+    int k = 0;
+    for (int i = 0; i < n; i++) {
+        while (k >= 2 && cross2(hull[k - 2], hull[k - 1], points[i]) <= 0) {
+            k--;
+        }
+        hull[k++] = points[i];
+    }
+    for (int i = n - 2, lower = k + 1; i >= 0; i--) {
+        while (k >= lower && cross2(hull[k - 2], hull[k - 1], points[i]) <= 0) {
+            k--;
+        }
+        hull[k++] = points[i];
+    }
+    return k - 1; // The first point is repeated at the end
+}
+
+// Sutherland-Hodgman: clips the polygon in place against the convex polygon clip; returns the new size
+static int clipPolygon(Point2* polygon, int n, const Point2* clip, int m) {
+    Point2 input[ANALYTIC_MAX_VERTICES];
+    for (int e = 0; e < m && n > 0; e++) {
+        const Point2& a = clip[e];
+        const Point2& b = clip[(e + 1) % m];
+        for (int i = 0; i < n; i++) {
+            input[i] = polygon[i];
+        }
+        int count = n;
+        n = 0;
+        for (int i = 0; i < count; i++) {
+            const Point2& p = input[i];
+            const Point2& q = input[(i + 1) % count];
+            double sp = cross2(a, b, p), sq = cross2(a, b, q);
+            if (sp >= 0) {
+                polygon[n++] = p;
+            }
+            if ((sp >= 0) != (sq >= 0) && n < ANALYTIC_MAX_VERTICES) {
+                double t = sp / (sp - sq);
+                polygon[n].x = p.x + t * (q.x - p.x);
+                polygon[n].y = p.y + t * (q.y - p.y);
+                n++;
+            }
+        }
+    }
+    return n;
+}
+
+static double dot3(const double* a, const double* b) {
+    return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+// ** Other functions **
+void getProjectionBasis(const double* r, double* e1, double* e2) {
+    // Crossing r with the axis it is least aligned with
+    int axis = fabs(r[0]) < fabs(r[1]) ? (fabs(r[0]) < fabs(r[2]) ? 0 : 2) : (fabs(r[1]) < fabs(r[2]) ? 1 : 2);
+    double other[3] = { 0, 0, 0 };
+    other[axis] = 1;
+    e1[0] = r[1] * other[2] - r[2] * other[1];
+    e1[1] = r[2] * other[0] - r[0] * other[2];
+    e1[2] = r[0] * other[1] - r[1] * other[0];
+    double e1Mag = sqrt(dot3(e1, e1));
+    for (int i = 0; i < 3; i++) {
+        e1[i] /= e1Mag;
+    }
+    e2[0] = r[1] * e1[2] - r[2] * e1[1];
+    e2[1] = r[2] * e1[0] - r[0] * e1[2];
+    e2[2] = r[0] * e1[1] - r[1] * e1[0];
+    double e2Mag = sqrt(dot3(e2, e2));
+    for (int i = 0; i < 3; i++) {
+        e2[i] /= e2Mag;
+    }
+}
+
+double getCollectorFraction(const Panel& panel, const Vector& sunVec, const Collector& collector) {
+    const Plane& plane = panel.getPlane();
+    double normal[3] = { panel.getNormal().getX(), panel.getNormal().getY(), panel.getNormal().getZ() };
+    double v[3] = { sunVec.getX(), sunVec.getY(), sunVec.getZ() };
+    if (fabs(plane.getc()) < 1e-6 || !(dot3(normal, v) < 0)) {
+        return 0; // Vertical or facing away from the sun, as in traceBeams
+    }
+
+    // Reflected direction, as in Ray::reflectAt, and two unit vectors across it
+    double scale = 2 * dot3(v, normal) / dot3(normal, normal);
+    double r[3] = { v[0] - scale * normal[0], v[1] - scale * normal[1], v[2] - scale * normal[2] };
+    double e1[3], e2[3];
+    getProjectionBasis(r, e1, e2);
+
+    // The panel quad, counterclockwise in the projection
+    Point2 quad[ANALYTIC_MAX_VERTICES];
+    float xs[4] = { panel.getMinX(), panel.getMaxX(), panel.getMaxX(), panel.getMinX() };
+    float ys[4] = { panel.getMinY(), panel.getMinY(), panel.getMaxY(), panel.getMaxY() };
+    for (int i = 0; i < 4; i++) {
+        double corner[3] = { xs[i], ys[i], plane.getZ(xs[i], ys[i]) };
+        quad[i].x = dot3(corner, e1);
+        quad[i].y = dot3(corner, e2);
+    }
+    double quadArea = getPolygonArea(quad, 4);
+    if (quadArea < 0) {
+        Point2 temp = quad[1]; quad[1] = quad[3]; quad[3] = temp;
+        quadArea = -quadArea;
+    }
+    if (quadArea <= 0) {
+        return 0;
+    }
+
+    // The reflected rays leave the front of the panel, so only the part of the box in front of its
+    // plane can be reached: the corners in front and the points where the edges cross the plane
+    double d = plane.getd();
+    double boxMin[3] = { collector.getMinX().getd(), collector.getMinY().getd(), collector.getMinZ().getd() };
+    double boxMax[3] = { collector.getMaxX().getd(), collector.getMaxY().getd(), collector.getMaxZ().getd() };
+    double corners[8][3], sides[8];
+    for (int c = 0; c < 8; c++) {
+        corners[c][0] = c & 1 ? boxMax[0] : boxMin[0];
+        corners[c][1] = c & 2 ? boxMax[1] : boxMin[1];
+        corners[c][2] = c & 4 ? boxMax[2] : boxMin[2];
+        sides[c] = dot3(normal, corners[c]) - d;
+    }
+    Point2 points[20];
+    int numPoints = 0;
+    for (int c = 0; c < 8; c++) {
+        if (sides[c] >= 0) {
+            points[numPoints].x = dot3(corners[c], e1);
+            points[numPoints].y = dot3(corners[c], e2);
+            numPoints++;
+        }
+        for (int bit = 1; bit < 8; bit <<= 1) {
+            int c2 = c | bit;
+            if (c2 == c || (sides[c] >= 0) == (sides[c2] >= 0)) {
+                continue;
+            }
+            double t = sides[c] / (sides[c] - sides[c2]);
+            double crossing[3];
+            for (int i = 0; i < 3; i++) {
+                crossing[i] = corners[c][i] + t * (corners[c2][i] - corners[c][i]);
+            }
+            points[numPoints].x = dot3(crossing, e1);
+            points[numPoints].y = dot3(crossing, e2);
+            numPoints++;
+        }
+    }
+    Point2 silhouette[ANALYTIC_MAX_VERTICES];
+    int numSilhouette = getConvexHull(points, numPoints, silhouette);
+    if (numSilhouette < 3) {
+        return 0;
+    }
+
+    int n = clipPolygon(quad, 4, silhouette, numSilhouette);
+    if (n < 3) {
+        return 0;
+    }
+    double fraction = getPolygonArea(quad, n) / quadArea;
+    return fraction < 0 ? 0 : (fraction > 1 ? 1 : fraction);
+}
+
+void traceAnalytic(const Sun& sun, const Collector& collector, const vector<Panel>& panels, TraceCounts& counts, int numThreads) {
+    Vector sunVec = sun.getDirection() * -1;
+    counts.reset(panels.size());
+    counts.panelFractions.resize(panels.size());
+    vector<float>& fractions = counts.panelFractions;
+    ThreadPool::shared().parallelFor(panels.size(), [&](int p) {
+        fractions[p] = getCollectorFraction(panels[p], sunVec, collector);
+    }, numThreads);
+}
+
+#endif
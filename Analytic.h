@@ -0,0 +1,25 @@
+#ifndef Analytic_h
+#define Analytic_h
+
+#include <vector>
+#include "Ray.h" // Also gets Position.h and Components.h
+
+#define ANALYTIC_MAX_VERTICES 32 // Vertices of the clipped polygons; a panel has 4, a box silhouette at most 6
+
+using namespace std;
+
+// Unit vectors e1 and e2 across the direction r, so that (e1, e2, r) is orthogonal
+void getProjectionBasis(const double* r, double* e1, double* e2);
+
+// Fraction of the area of the panel whose reflections of parallel rays along sunVec reach the box of
+// the collector. Every point of a flat panel reflects in the same direction, so the panel quad and the
+// silhouette of the collector (the part in front of the panel) are projected along that direction onto
+// one plane and clipped against each other. Panels facing away from the sun give 0.
+double getCollectorFraction(const Panel& panel, const Vector& sunVec, const Collector& collector);
+
+// Exact counterpart of traceBeams for the parallel-ray sun: fills counts.panelFractions with the
+// collector fraction of every panel, in parallel over the panels. Neither shading nor the sun disk
+// is modelled, and no rays are counted.
+void traceAnalytic(const Sun& sun, const Collector& collector, const vector<Panel>& panels, TraceCounts& counts, int numThreads = 1);
+
+#endif
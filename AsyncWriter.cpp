@@ -0,0 +1,281 @@
+#ifndef AsyncWriter_cpp
+#define AsyncWriter_cpp
+
+#include "AsyncWriter.h"
+
+// ** AsyncWriter Class **
+AsyncWriter::AsyncWriter() {
+    pendingBytes = 0;
+    nextFile = 0;
+    busy = false;
+    stopping = false;
+    worker = thread(&AsyncWriter::workerLoop, this);
+}
+
+AsyncWriter::~AsyncWriter() {
+    {
+        lock_guard<mutex> lock(stateMutex);
+        stopping = true;
+    }
+    workAvailable.notify_all();
+    worker.join(); // The worker empties the queue first
+    for (map<int, FILE*>::iterator fileIdx = files.begin(); fileIdx != files.end(); fileIdx++) {
+        if (fclose(fileIdx->second) != 0) {
+            fail(fileIdx->first, "Could not write " + fileNames[fileIdx->first]);
+        }
+    }
+    reportErrors();
+}
+
+void AsyncWriter::workerLoop() {
+    while (true) {
+        Job job;
+        {
+            unique_lock<mutex> lock(stateMutex);
+            workAvailable.wait(lock, [this] { return stopping || !jobs.empty(); });
+            if (jobs.empty()) {
+                return; // Stopping and nothing left to write
+            }
+            job = move(jobs.front());
+            jobs.pop_front();
+            busy = true;
+        }
+
+        runJob(job);
+
+        {
+            lock_guard<mutex> lock(stateMutex);
+            if (job.type == WRITE_FILE) {
+                pendingBytes -= job.size;
+                if (freeBuffers.size() < ASYNC_FREE_BUFFERS) {
+                    freeBuffers.push_back(move(job.data));
+                }
+            }
+            busy = false;
+        }
+        workDone.notify_all();
+    }
+}
+
+void AsyncWriter::runJob(Job& job) {
+    if (job.type == OPEN_FILE) {
+        FILE* f = fopen(job.fileName.c_str(), "wb");
+        if (f == NULL) {
+            fail(job.file, "Could not open " + job.fileName + " for writing");
+            return;
+        }
+        files[job.file] = f;
+        fileNames[job.file] = job.fileName;
+        return;
+    }
+    map<int, FILE*>::iterator fileIdx = files.find(job.file);
+    if (fileIdx == files.end()) {
+        return; // The file could not be opened
+    }
+    if (job.type == WRITE_FILE) {
+        if (fwrite(&job.data[0], 1, job.size, fileIdx->second) != job.size) {
+            fail(job.file, "Could not write " + fileNames[job.file]);
+        }
+    }
+    else {
+        if (fclose(fileIdx->second) != 0) { // Also reports the buffered data fclose could not write
+            fail(job.file, "Could not write " + fileNames[job.file]);
+        }
+        files.erase(fileIdx);
+        fileNames.erase(job.file);
+    }
+}
+
+void AsyncWriter::fail(int file, const string& error) {
+    lock_guard<mutex> lock(stateMutex);
+    if (failedFiles.insert(file).second) { // Only the first error of each file
+        errors.push_back(error);
+    }
+}
+
+bool AsyncWriter::reportErrors() {
+    vector<string> reported;
+    {
+        lock_guard<mutex> lock(stateMutex);
+        reported.swap(errors);
+    }
+    for (size_t i = 0; i < reported.size(); i++) {
+        cerr << reported[i] << endl;
+    }
+    return reported.empty();
+}
+
+void AsyncWriter::push(Job& job) {
+    {
+        lock_guard<mutex> lock(stateMutex);
+        jobs.push_back(move(job));
+    }
+    workAvailable.notify_one();
+}
+
+int AsyncWriter::open(const string& fileName) {
+    Job job;
+    job.type = OPEN_FILE;
+    job.fileName = fileName;
+    job.size = 0;
+    {
+        lock_guard<mutex> lock(stateMutex);
+        job.file = nextFile++;
+    }
+    int file = job.file;
+    push(job);
+    return file;
+}
+
+void AsyncWriter::write(int file, vector<char>& buffer, size_t size) {
+    Job job;
+    job.type = WRITE_FILE;
+    job.file = file;
+    job.size = size;
+    {
+        unique_lock<mutex> lock(stateMutex);
+        workDone.wait(lock, [this] { return pendingBytes < ASYNC_MAX_PENDING; });
+        pendingBytes += size;
+        job.data.swap(buffer);
+        if (!freeBuffers.empty()) {
+            buffer.swap(freeBuffers.back());
+            freeBuffers.pop_back();
+        }
+        jobs.push_back(move(job));
+    }
+    workAvailable.notify_one();
+    if (buffer.size() < ASYNC_BUFFER_SIZE) {
+        buffer.resize(ASYNC_BUFFER_SIZE);
+    }
+}
+
+void AsyncWriter::close(int file) {
+    Job job;
+    job.type = CLOSE_FILE;
+    job.file = file;
+    job.size = 0;
+    push(job);
+}
+
+bool AsyncWriter::wait() {
+    {
+        unique_lock<mutex> lock(stateMutex);
+        workDone.wait(lock, [this] { return jobs.empty() && !busy; });
+    }
+    return reportErrors();
+}
+
+bool AsyncWriter::failed(int file) {
+    lock_guard<mutex> lock(stateMutex);
+    return failedFiles.count(file) > 0;
+}
+
+AsyncWriter& AsyncWriter::shared() {
+    static AsyncWriter writer;
+    return writer;
+}
+
+// ** AsyncFileBuf Class **
+AsyncFileBuf::AsyncFileBuf() {
+    file = -1;
+}
+
+AsyncFileBuf::~AsyncFileBuf() {
+    close();
+}
+
+void AsyncFileBuf::handOff() {
+    size_t size = pptr() - pbase();
+    if (size > 0) {
+        AsyncWriter::shared().write(file, buffer, size);
+    }
+    setp(&buffer[0], &buffer[0] + buffer.size());
+}
+
+AsyncFileBuf::int_type AsyncFileBuf::overflow(int_type c) {
+    if (file < 0 || failed()) {
+        return traits_type::eof();
+    }
+    handOff();
+    if (!traits_type::eq_int_type(c, traits_type::eof())) {
+        *pptr() = traits_type::to_char_type(c);
+        pbump(1);
+    }
+    return traits_type::not_eof(c);
+}
+
+int AsyncFileBuf::sync() {
+    if (file >= 0) {
+        handOff();
+    }
+    return failed() ? -1 : 0;
+}
+
+bool AsyncFileBuf::open(const string& fileName) {
+    close();
+    file = AsyncWriter::shared().open(fileName);
+    buffer.resize(ASYNC_BUFFER_SIZE);
+    setp(&buffer[0], &buffer[0] + buffer.size());
+    return true;
+}
+
+bool AsyncFileBuf::close() {
+    if (file < 0) {
+        return true;
+    }
+    handOff();
+    bool good = !failed();
+    AsyncWriter::shared().close(file);
+    file = -1;
+    setp(NULL, NULL);
+    return good;
+}
+
+bool AsyncFileBuf::is_open() const {
+    return file >= 0;
+}
+
+bool AsyncFileBuf::failed() const {
+    return file >= 0 && AsyncWriter::shared().failed(file);
+}
+
+// ** AsyncOfstream Class **
+AsyncOfstream::AsyncOfstream() : ostream(NULL) {
+    rdbuf(&buf);
+}
+
+AsyncOfstream::AsyncOfstream(const string& fileName) : ostream(NULL) {
+    rdbuf(&buf);
+    open(fileName);
+}
+
+void AsyncOfstream::open(const string& fileName) {
+    buf.open(fileName);
+    clear();
+}
+
+void AsyncOfstream::close() {
+    if (!buf.close()) {
+        setstate(badbit);
+    }
+}
+
+bool AsyncOfstream::is_open() const {
+    return buf.is_open();
+}
+
+bool AsyncOfstream::wait() {
+    flush();
+    AsyncWriter::shared().wait();
+    if (buf.failed()) {
+        setstate(badbit);
+    }
+    return good();
+}
+
+// ** Other Functions **
+bool waitForOutput() {
+    return AsyncWriter::shared().wait();
+}
+
+#endif
@@ -0,0 +1,111 @@
+#ifndef AsyncWriter_h
+#define AsyncWriter_h
+
+#include <iostream>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <set>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#define ASYNC_BUFFER_SIZE (1 << 20) // Bytes an AsyncOfstream collects before handing them to the writer thread
+#define ASYNC_MAX_PENDING (64 << 20) // Writers wait once this many bytes are queued for the disk
+#define ASYNC_FREE_BUFFERS 8 // Empty buffers kept for reuse
+
+using namespace std;
+
+// A background thread that does all the file I/O of the program. Files are opened, written
+// and closed in the order the requests are queued, so a file that is written again later in
+// the run never races with its earlier contents. Pending output is written before exit.
+// A file that cannot be opened or written is marked as failed (see failed()), and the error is
+// reported on cerr by the next wait(), or at exit if nothing waited for it.
+class AsyncWriter {
+private:
+    enum JobType { OPEN_FILE, WRITE_FILE, CLOSE_FILE };
+    struct Job {
+        JobType type;
+        int file;
+        string fileName;
+        vector<char> data;
+        size_t size;
+    };
+
+    thread worker;
+    mutex stateMutex;
+    condition_variable workAvailable, workDone;
+    deque<Job> jobs;
+    vector<vector<char> > freeBuffers;
+    size_t pendingBytes;
+    int nextFile;
+    bool busy;
+    bool stopping;
+    set<int> failedFiles;
+    vector<string> errors; // Not reported yet
+
+    map<int, FILE*> files; // Only used by the writer thread
+    map<int, string> fileNames; // Only used by the writer thread
+
+    void workerLoop();
+    void runJob(Job& job);
+    void fail(int file, const string& error);
+    void push(Job& job);
+    bool reportErrors(); // Prints the errors not reported yet; false if there were any
+public:
+    AsyncWriter();
+    ~AsyncWriter();
+
+    int open(const string& fileName); // Returns the id used by write and close
+    // Queues the first size bytes of buffer and swaps buffer with an empty one of the same capacity
+    void write(int file, vector<char>& buffer, size_t size);
+    void close(int file);
+    // Blocks until everything queued so far is on disk. Returns false if a file failed since the last wait.
+    bool wait();
+    bool failed(int file); // Whether opening or writing the file has failed so far
+
+    static AsyncWriter& shared();
+};
+
+// Stream buffer that collects output in ASYNC_BUFFER_SIZE blocks for the shared AsyncWriter.
+// Flushing (including std::endl) only queues the block; it never waits for the disk.
+class AsyncFileBuf : public streambuf {
+private:
+    vector<char> buffer;
+    int file;
+
+    void handOff();
+protected:
+    int_type overflow(int_type c); // Also fails once the writer thread could not open or write the file
+    int sync();
+public:
+    AsyncFileBuf();
+    ~AsyncFileBuf();
+    bool open(const string& fileName);
+    bool close(); // False if the file failed before it was closed
+    bool is_open() const;
+    bool failed() const; // Whether the writer thread could not open or write the file so far
+};
+
+// Drop-in replacement for ofstream on the Data/ output files. The file is opened and written by the
+// writer thread, so a failure only shows in the state of the stream (badbit) from the next flush or
+// close on; wait() gives a definite answer.
+class AsyncOfstream : public ostream {
+private:
+    AsyncFileBuf buf;
+public:
+    AsyncOfstream();
+    explicit AsyncOfstream(const string& fileName);
+    void open(const string& fileName);
+    void close();
+    bool is_open() const;
+    bool wait(); // Waits until the output so far is on disk; false (and badbit) if the file failed
+};
+
+// Waits until all AsyncOfstream output has been written. Returns false, after printing the errors on
+// cerr, if a file could not be opened or written since the last wait.
+bool waitForOutput();
+
+#endif
@@ -0,0 +1,409 @@
+#ifndef BVH_cpp
+#define BVH_cpp
+
+#include <float.h>
+#include <limits.h>
+#include <algorithm>
+#include "BVH.h"
+#include "Ray.h"
+
+#define BVH_LEAF_SIZE 4
+#define BVH_STACK_SIZE 64
+// A traversal holds at most one node more than the depth of the tree on its stack, so nodes this deep
+// are always leaves, however many panels they hold
+#define BVH_MAX_DEPTH (BVH_STACK_SIZE - 1)
+#define OCCLUSION_EPSILON 1e-4 // Part of a segment at each end that is not tested, so it never hits the panels it starts or ends on
+
+// ** BoundingBox Class **
+BoundingBox::BoundingBox() {
+    for (int i = 0; i < 3; i++) {
+        minB[i] = FLT_MAX;
+        maxB[i] = -FLT_MAX;
+    }
+}
+void BoundingBox::expand(const Point& point) {
+    float p[3] = { point.getX(), point.getY(), point.getZ() };
+    for (int i = 0; i < 3; i++) {
+        if (!isfinite(p[i])) { // Vertical panels have no finite z extent
+            minB[i] = -FLT_MAX;
+            maxB[i] = FLT_MAX;
+            continue;
+        }
+        minB[i] = fmin(minB[i], p[i]);
+        maxB[i] = fmax(maxB[i], p[i]);
+    }
+}
+void BoundingBox::expand(const BoundingBox& box) {
+    for (int i = 0; i < 3; i++) {
+        minB[i] = fmin(minB[i], box.minB[i]);
+        maxB[i] = fmax(maxB[i], box.maxB[i]);
+    }
+}
+void BoundingBox::pad(float amount) {
+    for (int i = 0; i < 3; i++) {
+        if (minB[i] > -FLT_MAX) minB[i] -= amount;
+        if (maxB[i] < FLT_MAX) maxB[i] += amount;
+    }
+}
+float BoundingBox::getMin(int axis) const {
+    return minB[axis];
+}
+float BoundingBox::getMax(int axis) const {
+    return maxB[axis];
+}
+float BoundingBox::getCenter(int axis) const {
+    return (float)0.5 * (minB[axis] + maxB[axis]);
+}
+int BoundingBox::getLongestAxis() const {
+    int axis = 0;
+    for (int i = 1; i < 3; i++) {
+        if (maxB[i] - minB[i] > maxB[axis] - minB[axis]) {
+            axis = i;
+        }
+    }
+    return axis;
+}
+bool BoundingBox::intersects(const Vector& point, const Vector& direction) const {
+    float p[3] = { point.getX(), point.getY(), point.getZ() };
+    float d[3] = { direction.getX(), direction.getY(), direction.getZ() };
+    float tMin = -FLT_MAX, tMax = FLT_MAX;
+    for (int i = 0; i < 3; i++) {
+        if (d[i] == 0) { // Parallel to the slab: the line is either always in or always out
+            if (p[i] < minB[i] || p[i] > maxB[i]) {
+                return false;
+            }
+            continue;
+        }
+        float t1 = (minB[i] - p[i]) / d[i];
+        float t2 = (maxB[i] - p[i]) / d[i];
+        if (t1 > t2) {
+            float temp = t1; t1 = t2; t2 = temp;
+        }
+        tMin = fmax(tMin, t1);
+        tMax = fmin(tMax, t2);
+        if (tMin > tMax) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool BoundingBox::intersectsSegment(const Point& from, const Point& to) const {
+    float p[3] = { from.getX(), from.getY(), from.getZ() };
+    float d[3] = { to.getX() - from.getX(), to.getY() - from.getY(), to.getZ() - from.getZ() };
+    float tMin = 0, tMax = 1;
+    for (int i = 0; i < 3; i++) {
+        if (d[i] == 0) {
+            if (p[i] < minB[i] || p[i] > maxB[i]) {
+                return false;
+            }
+            continue;
+        }
+        float t1 = (minB[i] - p[i]) / d[i];
+        float t2 = (maxB[i] - p[i]) / d[i];
+        if (t1 > t2) {
+            float temp = t1; t1 = t2; t2 = temp;
+        }
+        tMin = fmax(tMin, t1);
+        tMax = fmin(tMax, t2);
+        if (tMin > tMax) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// ** PanelBVH Class **
+PanelBVH::PanelBVH() {}
+
+void PanelBVH::build(const vector<Panel>& panels) {
+    clear();
+    if (panels.empty()) {
+        return;
+    }
+    for (int i = 0; i < (int)panels.size(); i++) {
+        panelIndices.push_back(i);
+        panelBoxes.push_back(getPanelBounds(panels[i]));
+        panelCenters.push_back(panels[i].getCenter());
+    }
+    nodes.reserve(2 * panels.size());
+    buildNode(0, panels.size(), 0);
+}
+
+// Splits the panels at the median of the longest axis of their centers
+int PanelBVH::buildNode(int start, int count, int depth) {
+    int nodeIdx = nodes.size();
+    nodes.push_back(Node());
+
+    BoundingBox box, centers;
+    int minIndex = INT_MAX;
+    for (int i = start; i < start + count; i++) {
+        box.expand(panelBoxes[panelIndices[i]]);
+        centers.expand(panelCenters[panelIndices[i]]);
+        minIndex = min(minIndex, panelIndices[i]);
+    }
+    nodes[nodeIdx].box = box;
+    nodes[nodeIdx].minIndex = minIndex;
+    nodes[nodeIdx].left = nodes[nodeIdx].right = -1;
+
+    if (count <= BVH_LEAF_SIZE || depth >= BVH_MAX_DEPTH) {
+        nodes[nodeIdx].start = start;
+        nodes[nodeIdx].count = count;
+        return nodeIdx;
+    }
+
+    int axis = centers.getLongestAxis();
+    const vector<Point>& c = panelCenters;
+    int mid = start + count / 2;
+    nth_element(panelIndices.begin() + start, panelIndices.begin() + mid, panelIndices.begin() + start + count, [&c, axis](int a, int b) {
+        float ca = axis == 0 ? c[a].getX() : (axis == 1 ? c[a].getY() : c[a].getZ());
+        float cb = axis == 0 ? c[b].getX() : (axis == 1 ? c[b].getY() : c[b].getZ());
+        return ca < cb || (ca == cb && a < b);
+    });
+
+    int left = buildNode(start, mid - start, depth + 1);
+    int right = buildNode(mid, start + count - mid, depth + 1);
+    nodes[nodeIdx].start = 0;
+    nodes[nodeIdx].count = 0;
+    nodes[nodeIdx].left = left;
+    nodes[nodeIdx].right = right;
+    return nodeIdx;
+}
+
+void PanelBVH::refit(const vector<Panel>& panels) {
+    for (size_t i = 0; i < panelBoxes.size(); i++) {
+        panelBoxes[i] = getPanelBounds(panels[i]);
+    }
+    // Children always come after their parent in nodes
+    for (int n = nodes.size() - 1; n >= 0; n--) {
+        Node& node = nodes[n];
+        BoundingBox box;
+        if (node.count > 0) {
+            for (int i = node.start; i < node.start + node.count; i++) {
+                box.expand(panelBoxes[panelIndices[i]]);
+            }
+        }
+        else {
+            box.expand(nodes[node.left].box);
+            box.expand(nodes[node.right].box);
+        }
+        node.box = box;
+    }
+}
+
+void PanelBVH::clear() {
+    nodes.clear();
+    panelIndices.clear();
+    panelBoxes.clear();
+    panelCenters.clear();
+}
+
+bool PanelBVH::empty() const {
+    return nodes.empty();
+}
+
+int PanelBVH::getNumOfNodes() const {
+    return nodes.size();
+}
+
+int PanelBVH::firstHit(const Ray& ray, const vector<Panel>& panels, Point& intersection) const {
+    if (nodes.empty()) {
+        return -1;
+    }
+    const Vector& point = ray.getLine().getPointVector();
+    const Vector& direction = ray.getLine().getDirectionVector();
+
+    int best = INT_MAX;
+    int stack[BVH_STACK_SIZE];
+    int top = 0;
+    stack[top++] = 0;
+    while (top > 0) {
+        const Node& node = nodes[stack[--top]];
+        // Nothing in this subtree can come before the panel already found
+        if (node.minIndex >= best || !node.box.intersects(point, direction)) {
+            continue;
+        }
+        if (node.count > 0) {
+            for (int i = node.start; i < node.start + node.count; i++) {
+                int panelIdx = panelIndices[i];
+                Point candidate;
+                if (panelIdx < best && ray.intersectsPanel(panels[panelIdx], candidate)) {
+                    best = panelIdx;
+                    intersection = candidate;
+                }
+            }
+        }
+        else {
+            stack[top++] = node.right;
+            stack[top++] = node.left;
+        }
+    }
+    return best == INT_MAX ? -1 : best;
+}
+
+int PanelBVH::closestHit(const Ray& ray, const vector<Panel>& panels, Point& intersection, int& numHits) const {
+    numHits = 0;
+    if (nodes.empty()) {
+        return -1;
+    }
+    const Vector& point = ray.getLine().getPointVector();
+    const Vector& direction = ray.getLine().getDirectionVector();
+
+    int best = -1;
+    float bestDistance = FLT_MAX;
+    int stack[BVH_STACK_SIZE];
+    int top = 0;
+    stack[top++] = 0;
+    while (top > 0) {
+        const Node& node = nodes[stack[--top]];
+        if (!node.box.intersects(point, direction)) {
+            continue;
+        }
+        if (node.count > 0) {
+            for (int i = node.start; i < node.start + node.count; i++) {
+                int panelIdx = panelIndices[i];
+                Point candidate;
+                if (ray.intersectsPanel(panels[panelIdx], candidate)) {
+                    numHits++;
+                    float distance = getDistanceAlongRay(ray, candidate);
+                    if (distance < bestDistance || (distance == bestDistance && panelIdx < best)) {
+                        best = panelIdx;
+                        bestDistance = distance;
+                        intersection = candidate;
+                    }
+                }
+            }
+        }
+        else {
+            stack[top++] = node.right;
+            stack[top++] = node.left;
+        }
+    }
+    return best;
+}
+
+bool PanelBVH::occluded(const Point& from, const Point& to, int skipPanel, const vector<Panel>& panels) const {
+    if (nodes.empty()) {
+        return false;
+    }
+    int stack[BVH_STACK_SIZE];
+    int top = 0;
+    stack[top++] = 0;
+    while (top > 0) {
+        const Node& node = nodes[stack[--top]];
+        if (!node.box.intersectsSegment(from, to)) {
+            continue;
+        }
+        if (node.count > 0) {
+            for (int i = node.start; i < node.start + node.count; i++) {
+                int panelIdx = panelIndices[i];
+                if (panelIdx != skipPanel && segmentHitsPanel(from, to, panels[panelIdx])) {
+                    return true;
+                }
+            }
+        }
+        else {
+            stack[top++] = node.right;
+            stack[top++] = node.left;
+        }
+    }
+    return false;
+}
+
+int PanelBVH::nearestHit(const Point& origin, const Vector& direction, int skipPanel, const vector<Panel>& panels, float& distance, int* numHits) const {
+    int best = -1;
+    distance = FLT_MAX;
+    if (nodes.empty()) {
+        return best;
+    }
+    Vector point(origin.getX(), origin.getY(), origin.getZ());
+    int stack[BVH_STACK_SIZE];
+    int top = 0;
+    stack[top++] = 0;
+    while (top > 0) {
+        const Node& node = nodes[stack[--top]];
+        if (!node.box.intersects(point, direction)) {
+            continue;
+        }
+        if (node.count > 0) {
+            for (int i = node.start; i < node.start + node.count; i++) {
+                int panelIdx = panelIndices[i];
+                float t;
+                if (panelIdx == skipPanel || !rayHitsPanel(origin, direction, panels[panelIdx], t)) {
+                    continue;
+                }
+                if (numHits != NULL) {
+                    (*numHits)++;
+                }
+                if (t < distance || (t == distance && panelIdx < best)) {
+                    best = panelIdx;
+                    distance = t;
+                }
+            }
+        }
+        else {
+            stack[top++] = node.right;
+            stack[top++] = node.left;
+        }
+    }
+    return best;
+}
+
+// ** Other functions **
+BoundingBox getPanelBounds(const Panel& panel) {
+    BoundingBox box;
+    const Plane& plane = panel.getPlane();
+    float xs[2] = { panel.getMinX(), panel.getMaxX() };
+    float ys[2] = { panel.getMinY(), panel.getMaxY() };
+    for (int i = 0; i < 2; i++) {
+        for (int j = 0; j < 2; j++) {
+            box.expand(Point(xs[i], ys[j], plane.getZ(xs[i], ys[j])));
+        }
+    }
+    // Rounding in getIntersection must never push a hit outside of the box
+    float largest = 1;
+    for (int i = 0; i < 3; i++) {
+        if (box.getMin(i) > -FLT_MAX && box.getMax(i) < FLT_MAX) {
+            largest = fmax(largest, fmax(fabs(box.getMin(i)), fabs(box.getMax(i))));
+        }
+    }
+    box.pad((float)1e-4 * largest);
+    return box;
+}
+
+// Parameter t in (tMin, tMax) where from + t * direction crosses the panel (either face)
+static bool crossesPanel(const Point& from, double dx, double dy, double dz, const Panel& panel, double tMin, double tMax, double& t) {
+    const Plane& plane = panel.getPlane();
+    double denominator = plane.geta() * dx + plane.getb() * dy + plane.getc() * dz;
+    if (denominator == 0) {
+        return false; // Parallel to the panel
+    }
+    t = (plane.getd() - plane.geta() * from.getX() - plane.getb() * from.getY() - plane.getc() * from.getZ()) / denominator;
+    if (t <= tMin || t >= tMax) {
+        return false;
+    }
+    double x = from.getX() + t * dx, y = from.getY() + t * dy;
+    return x <= panel.getMaxX() && x >= panel.getMinX() && y <= panel.getMaxY() && y >= panel.getMinY();
+}
+
+bool segmentHitsPanel(const Point& from, const Point& to, const Panel& panel) {
+    double t;
+    return crossesPanel(from, to.getX() - from.getX(), to.getY() - from.getY(), to.getZ() - from.getZ(), panel, OCCLUSION_EPSILON, 1 - OCCLUSION_EPSILON, t);
+}
+
+bool rayHitsPanel(const Point& origin, const Vector& direction, const Panel& panel, float& distance) {
+    double t;
+    if (!crossesPanel(origin, direction.getX(), direction.getY(), direction.getZ(), panel, 0, DBL_MAX, t)) {
+        return false;
+    }
+    distance = t;
+    return true;
+}
+
+float getDistanceAlongRay(const Ray& ray, const Point& point) {
+    const Point& sunPoint = ray.getSunPoint();
+    const Vector& v = ray.getVector();
+    return (point.getX() - sunPoint.getX()) * v.getX() + (point.getY() - sunPoint.getY()) * v.getY() + (point.getZ() - sunPoint.getZ()) * v.getZ();
+}
+
+#endif
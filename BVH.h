@@ -0,0 +1,87 @@
+#ifndef BVH_h
+#define BVH_h
+
+#include <vector>
+#include "Components.h" // Also gets Position.h
+
+using namespace std;
+
+class Ray;
+
+// Axis aligned box used by the panel hierarchy
+class BoundingBox {
+private:
+    float minB[3], maxB[3];
+public:
+    BoundingBox();
+    void expand(const Point& point);
+    void expand(const BoundingBox& box);
+    void pad(float amount);
+    float getMin(int axis) const;
+    float getMax(int axis) const;
+    float getCenter(int axis) const;
+    int getLongestAxis() const;
+
+    // Slab test of the (infinite) line point + t * direction against the box
+    bool intersects(const Vector& point, const Vector& direction) const;
+    // Slab test of the segment from -> to against the box
+    bool intersectsSegment(const Point& from, const Point& to) const;
+};
+
+// Bounding volume hierarchy over the bounding boxes of the panels. It is built once
+// per RayTracer::setup and replaces the search through every panel in generateRays.
+class PanelBVH {
+private:
+    struct Node {
+        BoundingBox box;
+        int start, count; // Range in panelIndices for leaves (count > 0)
+        int left, right;  // Children for inner nodes
+        int minIndex;     // Smallest panel index in the subtree
+    };
+
+    vector<Node> nodes;
+    vector<int> panelIndices;
+    vector<BoundingBox> panelBoxes;
+    vector<Point> panelCenters;
+
+    int buildNode(int start, int count, int depth);
+public:
+    PanelBVH();
+    void build(const vector<Panel>& panels);
+    // Recomputes the boxes after the panels turned in place. The tree only depends on the centers,
+    // so this gives the hierarchy build() would.
+    void refit(const vector<Panel>& panels);
+    void clear();
+    bool empty() const;
+    int getNumOfNodes() const;
+
+    // Returns the index of the first panel (in the order of panels) hit by the ray, or -1.
+    // This is the same panel the brute force search in generateRays stops at. The point
+    // where the ray hits that panel is returned in intersection.
+    int firstHit(const Ray& ray, const vector<Panel>& panels, Point& intersection) const;
+
+    // Returns the index of the panel the ray reaches first on its way from the sun (the nearest
+    // hit from its sun point), or -1. Ties go to the lower index. The number of panels the ray
+    // crosses, shaded ones included, is returned in numHits.
+    int closestHit(const Ray& ray, const vector<Panel>& panels, Point& intersection, int& numHits) const;
+
+    // True if a panel other than skipPanel (either face) crosses the segment from -> to
+    bool occluded(const Point& from, const Point& to, int skipPanel, const vector<Panel>& panels) const;
+
+    // Returns the nearest panel other than skipPanel (either face) in front of origin along direction,
+    // or -1. The distance is in lengths of direction. The number of panels crossed is added to numHits.
+    int nearestHit(const Point& origin, const Vector& direction, int skipPanel, const vector<Panel>& panels, float& distance, int* numHits = NULL) const;
+};
+
+BoundingBox getPanelBounds(const Panel& panel);
+
+// True if the segment from -> to crosses the panel (either face), away from its two ends
+bool segmentHitsPanel(const Point& from, const Point& to, const Panel& panel);
+
+// True if the half line origin + t * direction (t > 0) crosses the panel (either face); t is returned in distance
+bool rayHitsPanel(const Point& origin, const Vector& direction, const Panel& panel, float& distance);
+
+// Distance of the point from the sun point of the ray, measured along the ray
+float getDistanceAlongRay(const Ray& ray, const Point& point);
+
+#endif
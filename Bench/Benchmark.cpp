@@ -0,0 +1,252 @@
+#ifndef Benchmark_cpp
+#define Benchmark_cpp
+
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <ctime>
+#include <thread>
+#include "Benchmark.h"
+
+#define BENCH_MIN_TIME 0.2 // Seconds each benchmark runs for at least
+#define BENCH_MAX_ITERATIONS 1000000000L
+
+// ** BenchState Class **
+BenchState::BenchState(long maxIterations, const vector<long>& args) {
+    this->maxIterations = maxIterations;
+    this->args = args;
+    iteration = 0;
+    itemsProcessed = 0;
+    startCpu = endCpu = 0;
+    running = false;
+}
+bool BenchState::keepRunning() {
+    if (!running) {
+        running = true;
+        startTime = chrono::steady_clock::now();
+        startCpu = clock();
+    }
+    if (iteration < maxIterations) {
+        iteration++;
+        return true;
+    }
+    endTime = chrono::steady_clock::now();
+    endCpu = clock();
+    return false;
+}
+long BenchState::range(int i) const {
+    return i < (int)args.size() ? args[i] : 0;
+}
+long BenchState::iterations() const {
+    return maxIterations;
+}
+void BenchState::setItemsProcessed(long items) {
+    itemsProcessed = items;
+}
+void BenchState::setCounter(const string& name, double value) {
+    counters[name] = value;
+}
+void BenchState::skipWithError(const string& message) {
+    error = message;
+}
+long BenchState::getItemsProcessed() const {
+    return itemsProcessed;
+}
+const map<string, double>& BenchState::getCounters() const {
+    return counters;
+}
+const string& BenchState::getError() const {
+    return error;
+}
+double BenchState::getRealSeconds() const {
+    return chrono::duration<double>(endTime - startTime).count();
+}
+double BenchState::getCpuSeconds() const {
+    return (double)(endCpu - startCpu) / CLOCKS_PER_SEC;
+}
+
+// ** BenchEntry Class **
+BenchEntry::BenchEntry(const string& name, const function<void(BenchState&)>& fn) {
+    this->name = name;
+    this->fn = fn;
+}
+BenchEntry* BenchEntry::arg(long a) {
+    argSets.push_back(vector<long>(1, a));
+    return this;
+}
+BenchEntry* BenchEntry::args(const vector<long>& a) {
+    argSets.push_back(a);
+    return this;
+}
+const string& BenchEntry::getName() const {
+    return name;
+}
+const vector<vector<long> >& BenchEntry::getArgSets() const {
+    return argSets;
+}
+void BenchEntry::run(BenchState& state) const {
+    fn(state);
+}
+
+// ** Other functions **
+static vector<BenchEntry*>& getRegistry() {
+    static vector<BenchEntry*> registry;
+    return registry;
+}
+
+BenchEntry* registerBenchmark(const string& name, const function<void(BenchState&)>& fn) {
+    getRegistry().push_back(new BenchEntry(name, fn));
+    return getRegistry().back();
+}
+
+// One finished benchmark run
+struct BenchResult {
+    string name;
+    long iterations;
+    double realNs, cpuNs; // Per iteration
+    double itemsPerSecond;
+    map<string, double> counters;
+    string error; // Empty unless the run failed
+};
+
+static string jsonString(const string& s) {
+    string out = "\"";
+    for (size_t i = 0; i < s.size(); i++) {
+        if (s[i] == '"' || s[i] == '\\') {
+            out += '\\';
+        }
+        out += s[i];
+    }
+    return out + "\"";
+}
+
+static void printJson(ostream& out, const vector<BenchResult>& results, const char* executable) {
+    time_t now = time(NULL);
+    char date[64];
+    strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", localtime(&now));
+
+    out << setprecision(10);
+    out << "{" << endl;
+    out << "  \"context\": {" << endl;
+    out << "    \"date\": " << jsonString(date) << "," << endl;
+    out << "    \"executable\": " << jsonString(executable) << "," << endl;
+    out << "    \"num_cpus\": " << thread::hardware_concurrency() << "," << endl;
+    out << "    \"library_build_type\": \"release\"" << endl;
+    out << "  }," << endl;
+    out << "  \"benchmarks\": [" << endl;
+    for (size_t i = 0; i < results.size(); i++) {
+        const BenchResult& r = results[i];
+        out << "    {" << endl;
+        out << "      \"name\": " << jsonString(r.name) << "," << endl;
+        out << "      \"run_name\": " << jsonString(r.name) << "," << endl;
+        out << "      \"run_type\": \"iteration\"," << endl;
+        out << "      \"iterations\": " << r.iterations << "," << endl;
+        out << "      \"real_time\": " << r.realNs << "," << endl;
+        out << "      \"cpu_time\": " << r.cpuNs << "," << endl;
+        out << "      \"time_unit\": \"ns\"";
+        if (!r.error.empty()) {
+            out << "," << endl << "      \"error_occurred\": true," << endl << "      \"error_message\": " << jsonString(r.error);
+        }
+        if (r.itemsPerSecond > 0) {
+            out << "," << endl << "      \"items_per_second\": " << r.itemsPerSecond;
+        }
+        for (map<string, double>::const_iterator c = r.counters.begin(); c != r.counters.end(); c++) {
+            out << "," << endl << "      " << jsonString(c->first) << ": " << c->second;
+        }
+        out << endl << "    }" << (i + 1 < results.size() ? "," : "") << endl;
+    }
+    out << "  ]" << endl;
+    out << "}" << endl;
+}
+
+int runBenchmarks(int argc, char** argv) {
+    string filter, outFile;
+    double minTime = BENCH_MIN_TIME;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg.compare(0, 9, "--filter=") == 0) {
+            filter = arg.substr(9);
+        }
+        else if (arg.compare(0, 6, "--out=") == 0) {
+            outFile = arg.substr(6);
+        }
+        else if (arg.compare(0, 11, "--min_time=") == 0) {
+            minTime = stod(arg.substr(11));
+        }
+        else {
+            cerr << "Usage: " << argv[0] << " [--filter=<substring>] [--out=<file.json>] [--min_time=<seconds>]" << endl;
+            return 1;
+        }
+    }
+
+    vector<BenchResult> results;
+    int failures = 0;
+    cout << left << setw(44) << "Benchmark" << right << setw(16) << "Time (ns)" << setw(16) << "CPU (ns)" << setw(14) << "Iterations" << setw(18) << "Items/s" << endl;
+    cout << string(108, '-') << endl;
+    vector<BenchEntry*>& registry = getRegistry();
+    for (size_t b = 0; b < registry.size(); b++) {
+        vector<vector<long> > argSets = registry[b]->getArgSets();
+        if (argSets.empty()) {
+            argSets.push_back(vector<long>());
+        }
+        for (size_t a = 0; a < argSets.size(); a++) {
+            string name = registry[b]->getName();
+            for (size_t k = 0; k < argSets[a].size(); k++) {
+                name += "/" + to_string(argSets[a][k]);
+            }
+            if (!filter.empty() && name.find(filter) == string::npos) {
+                continue;
+            }
+
+            // Growing the iteration count until the run is long enough to time
+            long iterations = 1;
+            while (true) {
+                BenchState state(iterations, argSets[a]);
+                registry[b]->run(state);
+                double seconds = state.getRealSeconds();
+                if (seconds >= minTime || iterations >= BENCH_MAX_ITERATIONS || !state.getError().empty()) {
+                    BenchResult r;
+                    r.name = name;
+                    r.iterations = iterations;
+                    r.realNs = seconds * 1e9 / iterations;
+                    r.cpuNs = state.getCpuSeconds() * 1e9 / iterations;
+                    r.itemsPerSecond = state.getItemsProcessed() > 0 ? state.getItemsProcessed() / seconds : 0;
+                    r.counters = state.getCounters();
+                    r.error = state.getError();
+                    failures += !r.error.empty();
+                    results.push_back(r);
+                    cout << left << setw(44) << name << right << fixed << setprecision(1) << setw(16) << r.realNs << setw(16) << r.cpuNs << setw(14) << iterations;
+                    if (r.itemsPerSecond > 0) {
+                        cout << setw(18) << scientific << setprecision(3) << r.itemsPerSecond;
+                    }
+                    for (map<string, double>::const_iterator c = r.counters.begin(); c != r.counters.end(); c++) {
+                        cout << "  " << c->first << "=" << defaultfloat << setprecision(6) << c->second;
+                    }
+                    if (!r.error.empty()) {
+                        cout << "  ERROR: " << r.error;
+                    }
+                    cout << defaultfloat << endl;
+                    break;
+                }
+                double scale = seconds > 0 ? 1.4 * minTime / seconds : 10;
+                iterations = (long)(iterations * (scale < 10 ? (scale > 2 ? scale : 2) : 10));
+                if (iterations > BENCH_MAX_ITERATIONS) {
+                    iterations = BENCH_MAX_ITERATIONS;
+                }
+            }
+        }
+    }
+
+    if (!outFile.empty()) {
+        ofstream out(outFile.c_str());
+        printJson(out, results, argv[0]);
+        cout << endl << "Results written to " << outFile << endl;
+    }
+    if (failures > 0) {
+        cout << endl << failures << " benchmarks failed" << endl;
+        return 1;
+    }
+    return 0;
+}
+
+#endif
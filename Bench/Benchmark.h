@@ -0,0 +1,82 @@
+#ifndef Benchmark_h
+#define Benchmark_h
+
+#include <string>
+#include <vector>
+#include <map>
+#include <chrono>
+#include <functional>
+
+using namespace std;
+
+// A small benchmark harness in the style of Google Benchmark:
+//
+// static void BM_Something(BenchState& state) {
+//     ... setup using state.range(0) ...
+//     while (state.keepRunning()) {
+//         ... code to time ...
+//     }
+//     state.setItemsProcessed(state.iterations() * itemsPerIteration);
+// }
+// BENCHMARK(BM_Something)->arg(10)->arg(100);
+//
+// Results are printed as a table and can be written as Google Benchmark compatible JSON.
+class BenchState {
+private:
+    long maxIterations;
+    long iteration;
+    vector<long> args;
+    long itemsProcessed;
+    map<string, double> counters;
+    string error;
+    chrono::steady_clock::time_point startTime, endTime;
+    clock_t startCpu, endCpu;
+    bool running;
+public:
+    BenchState(long maxIterations, const vector<long>& args);
+    bool keepRunning(); // The timed loop; setup before and after it is not timed
+    long range(int i) const;
+    long iterations() const;
+    void setItemsProcessed(long items);
+    void setCounter(const string& name, double value);
+    void skipWithError(const string& message); // Marks the run as failed; runBenchmarks then returns 1
+
+    long getItemsProcessed() const;
+    const map<string, double>& getCounters() const;
+    const string& getError() const; // Empty unless the run failed
+    double getRealSeconds() const;
+    double getCpuSeconds() const;
+};
+
+class BenchEntry {
+private:
+    string name;
+    function<void(BenchState&)> fn;
+    vector<vector<long> > argSets;
+public:
+    BenchEntry(const string& name, const function<void(BenchState&)>& fn);
+    BenchEntry* arg(long a);
+    BenchEntry* args(const vector<long>& a);
+
+    const string& getName() const;
+    const vector<vector<long> >& getArgSets() const;
+    void run(BenchState& state) const;
+};
+
+BenchEntry* registerBenchmark(const string& name, const function<void(BenchState&)>& fn);
+
+// Runs every registered benchmark; see the usage string in Benchmark.cpp for the options.
+// Returns 1 if a benchmark failed.
+int runBenchmarks(int argc, char** argv);
+
+// Keeps the compiler from optimizing a value away
+template <class T>
+inline void doNotOptimize(const T& value) {
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+#define BENCHMARK_CONCAT2(a, b) a##b
+#define BENCHMARK_CONCAT(a, b) BENCHMARK_CONCAT2(a, b)
+#define BENCHMARK(fn) static BenchEntry* BENCHMARK_CONCAT(benchEntry_, __LINE__) = registerBenchmark(#fn, fn)
+
+#endif
@@ -0,0 +1,373 @@
+/*
+
+Benchmark suite of the ray tracer: micro benchmarks of the Vector operations and of the
+Ray/Panel/Collector intersection functions, and macro benchmarks of RayTracer::generate()
+over field sizes and ray densities.
+
+Build and run from the repository root (the JSON results go to Bench/results.json):
+
+make bench
+
+or build only and pick benchmarks by name:
+
+make benchmark && ./benchmark --filter=Generate --out=results.json
+
+*/
+
+#include "CountingAllocator.h" // Every heap allocation of the benchmark binary is counted
+#include "Benchmark.h"
+#include "../RayTracer.h"
+#include "../RayBatch.h"
+
+using namespace std;
+
+#define FIXTURE_RAYS 1024 // Rays the micro benchmarks cycle through
+
+// The default setup of main.cpp at 15:00: one panel, the collector and rays through the panel
+class Fixture {
+public:
+    Sun sun;
+    Collector collector;
+    Panel panel;
+    vector<Ray> rays;          // Sun rays over the panel
+    vector<Ray> reflectedRays; // Their reflections off the panel
+    vector<Vector> vectors;
+
+    Fixture() : sun(15), collector(Point(0, 0, 0.4), 0.07, 0.07, 0.2), panel(Point(0.2, 0.1, 0), sun.getDirection(), collector.getCenter(), 0.1) {
+        Vector sunVec = sun.getDirection() * -1;
+        for (int i = 0; i < FIXTURE_RAYS; i++) {
+            float x = 0.15 + 0.1 * (i % 32) / 32;
+            float y = 0.05 + 0.1 * (i / 32) / 32;
+            Point center(x, y, 1);
+            Ray ray(center, Point(x + sunVec.getX(), y + sunVec.getY(), 1 + sunVec.getZ()));
+            Ray reflectedRay;
+            ray.reflect(panel, reflectedRay);
+            rays.push_back(ray);
+            reflectedRays.push_back(reflectedRay);
+            vectors.push_back(Vector(x, y, 1 + 0.001 * i));
+        }
+    }
+};
+
+static Fixture& getFixture() {
+    static Fixture fixture;
+    return fixture;
+}
+
+// ** Vector operations **
+static void BM_VectorAdd(BenchState& state) {
+    const vector<Vector>& v = getFixture().vectors;
+    long i = 0;
+    while (state.keepRunning()) {
+        Vector sum = v[i % FIXTURE_RAYS] + v[(i + 1) % FIXTURE_RAYS];
+        doNotOptimize(sum);
+        i++;
+    }
+    state.setItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_VectorAdd);
+
+static void BM_VectorScale(BenchState& state) {
+    const vector<Vector>& v = getFixture().vectors;
+    long i = 0;
+    while (state.keepRunning()) {
+        Vector scaled = v[i % FIXTURE_RAYS] * 1.5f;
+        doNotOptimize(scaled);
+        i++;
+    }
+    state.setItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_VectorScale);
+
+static void BM_VectorDot(BenchState& state) {
+    const vector<Vector>& v = getFixture().vectors;
+    long i = 0;
+    while (state.keepRunning()) {
+        float dot = v[i % FIXTURE_RAYS].dot(v[(i + 1) % FIXTURE_RAYS]);
+        doNotOptimize(dot);
+        i++;
+    }
+    state.setItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_VectorDot);
+
+static void BM_VectorGetUnit(BenchState& state) {
+    const vector<Vector>& v = getFixture().vectors;
+    long i = 0;
+    while (state.keepRunning()) {
+        Vector unit = v[i % FIXTURE_RAYS].getUnit();
+        doNotOptimize(unit);
+        i++;
+    }
+    state.setItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_VectorGetUnit);
+
+static void BM_VectorGetAngle(BenchState& state) {
+    const vector<Vector>& v = getFixture().vectors;
+    long i = 0;
+    while (state.keepRunning()) {
+        float angle = v[i % FIXTURE_RAYS].getAngle(v[(i + 7) % FIXTURE_RAYS]);
+        doNotOptimize(angle);
+        i++;
+    }
+    state.setItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_VectorGetAngle);
+
+// ** Intersection functions **
+static void BM_GetIntersection(BenchState& state) {
+    Fixture& f = getFixture();
+    long i = 0;
+    while (state.keepRunning()) {
+        Point p = getIntersection(f.rays[i % FIXTURE_RAYS].getLine(), f.panel.getPlane());
+        doNotOptimize(p);
+        i++;
+    }
+    state.setItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_GetIntersection);
+
+static void BM_RayHitsPanel(BenchState& state) {
+    Fixture& f = getFixture();
+    vector<Ray> rays = f.rays;
+    long i = 0;
+    while (state.keepRunning()) {
+        bool hit = rays[i % FIXTURE_RAYS].hitsPanel(f.panel);
+        doNotOptimize(hit);
+        i++;
+    }
+    state.setItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_RayHitsPanel);
+
+static void BM_RayReflect(BenchState& state) {
+    Fixture& f = getFixture();
+    vector<Ray> rays = f.rays;
+    Ray reflectedRay;
+    long i = 0;
+    while (state.keepRunning()) {
+        bool hit = rays[i % FIXTURE_RAYS].reflect(f.panel, reflectedRay);
+        doNotOptimize(hit);
+        doNotOptimize(reflectedRay);
+        i++;
+    }
+    state.setItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_RayReflect);
+
+static void BM_RayHitsCollector(BenchState& state) {
+    Fixture& f = getFixture();
+    vector<Ray> rays = f.reflectedRays;
+    long i = 0;
+    while (state.keepRunning()) {
+        bool hit = rays[i % FIXTURE_RAYS].hitsCollector(f.collector);
+        doNotOptimize(hit);
+        i++;
+    }
+    state.setItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_RayHitsCollector);
+
+// The vectorized kernel that replaces Ray::intersectsPanel in generate(), per batch of FIXTURE_RAYS rays
+static void BM_IntersectPanelBatch(BenchState& state) {
+    Fixture& f = getFixture();
+    RayBatch batch;
+    for (int i = 0; i < FIXTURE_RAYS; i++) {
+        const Line& line = f.rays[i].getLine();
+        batch.push(line.getPointVector(), line.getDirectionVector());
+    }
+    vector<unsigned char> hits(FIXTURE_RAYS);
+    while (state.keepRunning()) {
+        intersectPanel(batch, f.panel, &hits[0]);
+        doNotOptimize(hits[0]);
+    }
+    state.setItemsProcessed(state.iterations() * FIXTURE_RAYS);
+}
+BENCHMARK(BM_IntersectPanelBatch);
+
+// The slab kernel that finds the collector crossings of the reflected rays in generate()
+static void BM_IntersectCollectorBatch(BenchState& state) {
+    Fixture& f = getFixture();
+    RayBatch batch;
+    for (int i = 0; i < FIXTURE_RAYS; i++) {
+        const Line& line = f.reflectedRays[i].getLine();
+        batch.push(line.getPointVector(), line.getDirectionVector());
+    }
+    vector<BoxCrossing> crossings(FIXTURE_RAYS);
+    while (state.keepRunning()) {
+        intersectCollector(batch, f.collector, &crossings[0]);
+        doNotOptimize(crossings[0]);
+    }
+    state.setItemsProcessed(state.iterations() * FIXTURE_RAYS);
+}
+BENCHMARK(BM_IntersectCollectorBatch);
+
+// Re-aiming a field of mirrors for a new sun. Argument: number of mirrors
+static void BM_AimField(BenchState& state) {
+    int numPanels = state.range(0);
+    Point target(50, 50, 30);
+    vector<Panel> panels;
+    for (int i = 0; i < numPanels; i++) {
+        panels.push_back(Panel(Point((i % 316) * 0.3, (i / 316) * 0.3, 0), Sun(9).getDirection(), target, 0.2));
+    }
+    HeliostatField field;
+    field.assign(panels);
+    Vector suns[2] = { Sun(9).getDirection(), Sun(14).getDirection() };
+    long i = 0;
+    while (state.keepRunning()) {
+        field.aim(suns[i++ % 2], target);
+        doNotOptimize(field.getPlaneD()[0]);
+    }
+    state.setItemsProcessed(state.iterations() * numPanels);
+}
+BENCHMARK(BM_AimField)->args({1000})->args({100000});
+
+// ** RayTracer::generate() **
+// Arguments: setup mode, rMax in cm (the field size of mode 0), N (rays per side of the sun plane grid)
+static void BM_Generate(BenchState& state) {
+    int mode = state.range(0);
+    float rMax = state.range(1) / 100.0;
+    int N = state.range(2);
+    RayTracer r(15, Point(0, 0, 0.4), Point(0.07, 0.07, 0.2), N, 0.2, rMax, 0.1, 0.2, 0);
+    r.setVerbose(false);
+    r.setup(mode, false);
+    r.generate(); // Warm up
+
+    while (state.keepRunning()) {
+        r.generate();
+    }
+    state.setItemsProcessed(state.iterations() * r.getNumOfRays());
+    state.setCounter("panels", r.getNumOfPanels());
+    state.setCounter("rays", r.getNumOfRays());
+}
+BENCHMARK(BM_Generate)
+    ->args({1, 60, 50})->args({1, 60, 100})->args({1, 60, 200})->args({1, 60, 400})
+    ->args({0, 60, 100})->args({0, 150, 100})->args({0, 300, 100})->args({0, 300, 400});
+
+// Same as BM_Generate but keeping every Ray, as main.cpp does for visualize()
+static void BM_GenerateStored(BenchState& state) {
+    int mode = state.range(0);
+    float rMax = state.range(1) / 100.0;
+    int N = state.range(2);
+    RayTracer r(15, Point(0, 0, 0.4), Point(0.07, 0.07, 0.2), N, 0.2, rMax, 0.1, 0.2, 0);
+    r.setVerbose(false);
+    r.setup(mode, false);
+    r.setStoreRays(true);
+    r.generate();
+
+    while (state.keepRunning()) {
+        r.generate();
+    }
+    state.setItemsProcessed(state.iterations() * r.getNumOfRays());
+}
+BENCHMARK(BM_GenerateStored)->args({1, 60, 100})->args({1, 60, 400});
+
+// Repeated generate() calls on one RayTracer, as in a sweep. The buffers of the first trace are
+// reused, so allocs_per_iter must be 0; the benchmark fails otherwise.
+// Arguments: setup mode, rMax in cm, N, 1 to keep the rays
+static void BM_GenerateSteadyState(BenchState& state) {
+    int mode = state.range(0);
+    float rMax = state.range(1) / 100.0;
+    int N = state.range(2);
+    RayTracer r(15, Point(0, 0, 0.4), Point(0.07, 0.07, 0.2), N, 0.2, rMax, 0.1, 0.2, 0);
+    r.setVerbose(false);
+    r.setup(mode, false);
+    r.setStoreRays(state.range(3) != 0);
+    r.generate();
+    r.eraseRayPowerData();
+    r.generate();
+
+    long before = allocations;
+    while (state.keepRunning()) {
+        r.eraseRayPowerData();
+        r.generate();
+    }
+    state.setItemsProcessed(state.iterations() * r.getNumOfRays());
+    long allocated = allocations - before; // Before setCounter, which allocates
+    state.setCounter("allocs_per_iter", (double)allocated / state.iterations());
+    if (allocated > 0) {
+        state.skipWithError("a steady-state trace allocated");
+    }
+}
+BENCHMARK(BM_GenerateSteadyState)->args({1, 60, 100, 0})->args({1, 60, 100, 1})->args({0, 300, 100, 0});
+
+// The fixed-field sweep step: the same field traced under another sun, into counts kept by the caller
+static void BM_GenerateFixedSteadyState(BenchState& state) {
+    RayTracer r(10, Point(0, 0, 0.4), Point(0.07, 0.07, 0.2), state.range(0), 0.2, 0.6, 0.1, 0.2, 0);
+    r.setVerbose(false);
+    r.setup(1, false);
+    float power, tempRate;
+    TraceCounts counts;
+    r.generateFixed(Sun(15), power, tempRate, counts);
+
+    long before = allocations;
+    while (state.keepRunning()) {
+        r.generateFixed(Sun(15), power, tempRate, counts);
+        doNotOptimize(power);
+    }
+    long allocated = allocations - before; // Before setCounter, which allocates
+    state.setCounter("allocs_per_iter", (double)allocated / state.iterations());
+    if (allocated > 0) {
+        state.skipWithError("a steady-state trace allocated");
+    }
+}
+BENCHMARK(BM_GenerateFixedSteadyState)->arg(100);
+
+// Same as BM_Generate with the multi-bounce engine, to compare against the single-bounce path
+static void BM_GenerateBounces(BenchState& state) {
+    int mode = state.range(0);
+    float rMax = state.range(1) / 100.0;
+    int N = state.range(2);
+    RayTracer r(15, Point(0, 0, 0.4), Point(0.07, 0.07, 0.2), N, 0.2, rMax, 0.1, 0.2, 0);
+    r.setVerbose(false);
+    r.setup(mode, false);
+    r.setEngine(ENGINE_BOUNCES);
+    r.generate();
+
+    while (state.keepRunning()) {
+        r.generate();
+    }
+    state.setItemsProcessed(state.iterations() * r.getNumOfRays());
+}
+BENCHMARK(BM_GenerateBounces)->args({1, 60, 100})->args({1, 60, 400})->args({0, 300, 100});
+
+// The analytic engine does not trace rays; items are panels. Arguments: setup mode, rMax in cm
+static void BM_GenerateAnalytic(BenchState& state) {
+    int mode = state.range(0);
+    float rMax = state.range(1) / 100.0;
+    RayTracer r(15, Point(0, 0, 0.4), Point(0.07, 0.07, 0.2), 100, 0.2, rMax, 0.1, 0.2, 0);
+    r.setVerbose(false);
+    r.setup(mode, false);
+    r.setEngine(ENGINE_ANALYTIC);
+    r.generate();
+
+    while (state.keepRunning()) {
+        r.generate();
+    }
+    state.setItemsProcessed(state.iterations() * r.getNumOfPanels());
+    state.setCounter("panels", r.getNumOfPanels());
+}
+BENCHMARK(BM_GenerateAnalytic)->args({1, 60})->args({0, 300});
+
+// The flux model estimates the intercept of every panel in closed form. Arguments: setup mode, rMax in cm
+static void BM_GenerateFluxModel(BenchState& state) {
+    int mode = state.range(0);
+    float rMax = state.range(1) / 100.0;
+    RayTracer r(15, Point(0, 0, 0.4), Point(0.07, 0.07, 0.2), 100, 0.2, rMax, 0.1, 0.2, 0);
+    r.setVerbose(false);
+    r.setup(mode, false);
+    r.setEngine(ENGINE_FLUX_MODEL);
+    r.generate();
+
+    while (state.keepRunning()) {
+        r.generate();
+    }
+    state.setItemsProcessed(state.iterations() * r.getNumOfPanels());
+    state.setCounter("panels", r.getNumOfPanels());
+}
+BENCHMARK(BM_GenerateFluxModel)->args({1, 60})->args({0, 300});
+
+int main(int argc, char** argv) {
+    return runBenchmarks(argc, argv);
+}
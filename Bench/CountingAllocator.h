@@ -0,0 +1,34 @@
+#ifndef CountingAllocator_h
+#define CountingAllocator_h
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+using namespace std;
+
+// Replacements of the global operator new and delete that count every heap allocation of the
+// program, so the steady-state runs of hotpath and benchmark can check that a trace does not
+// allocate. Include it in exactly one file of each program.
+static atomic<long> allocations(0);
+static atomic<long> allocatedBytes(0);
+
+void* operator new(size_t size) {
+    allocations++;
+    allocatedBytes += size;
+    void* p = malloc(size > 0 ? size : 1);
+    if (p == NULL) {
+        throw bad_alloc();
+    }
+    return p;
+}
+// Not inlined: GCC would otherwise see free() called on the result of a new expression at the call sites
+// and warn (-Wmismatched-new-delete), although the memory came from the malloc above
+__attribute__((noinline)) void operator delete(void* p) noexcept {
+    free(p);
+}
+void operator delete(void* p, size_t) noexcept {
+    operator delete(p);
+}
+
+#endif
@@ -0,0 +1,136 @@
+/*
+
+Micro benchmark of the intersection hot path: time per call of the Ray/Panel/Collector
+functions, and heap allocations per RayTracer::generate() once the tracer is warmed up.
+It exits with 1 if a warmed up generate() allocates, if ENGINE_BOUNCES without reflectors
+or receivers does not give the power of the shaded single-bounce grid, or if a reflector beside
+the field that sends its light away changes the power of ENGINE_BOUNCES.
+
+Build and run from the repository root:
+
+make hotpath && ./hotpath
+
+*/
+
+#include <chrono>
+#include "CountingAllocator.h"
+#include "../RayTracer.h"
+
+using namespace std;
+
+// ** Timing **
+template <class F>
+double nsPerCall(long iterations, F f) {
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for (long i = 0; i < iterations; i++) {
+        f(i);
+    }
+    chrono::steady_clock::time_point end = chrono::steady_clock::now();
+    return chrono::duration<double, nano>(end - start).count() / iterations;
+}
+
+volatile float sink;
+
+int main() {
+    const long iterations = 2000000;
+
+    Sun sun(15);
+    Collector collector(Point(0, 0, 0.4), 0.07, 0.07, 0.2);
+    Panel panel(Point(0.2, 0.1, 0), sun.getDirection(), collector.getCenter(), 0.1);
+    Vector sunVec = sun.getDirection() * -1;
+    Point center(0.2, 0.1, 1);
+    Ray ray(center, Point(center.getX() + sunVec.getX(), center.getY() + sunVec.getY(), center.getZ() + sunVec.getZ()));
+    Ray reflectedRay;
+    ray.reflect(panel, reflectedRay);
+
+    cout << "Call" << "\t\t\t" << "ns/call" << endl;
+    cout << "getIntersection\t\t" << nsPerCall(iterations, [&](long) {
+        sink = getIntersection(ray.getLine(), panel.getPlane()).getZ();
+    }) << endl;
+    cout << "Ray::hitsPanel\t\t" << nsPerCall(iterations, [&](long) {
+        Ray r = ray;
+        sink = r.hitsPanel(panel);
+    }) << endl;
+    cout << "Ray::reflect\t\t" << nsPerCall(iterations, [&](long) {
+        Ray r = ray;
+        Ray out;
+        sink = r.reflect(panel, out);
+    }) << endl;
+    cout << "Ray::hitsCollector\t" << nsPerCall(iterations, [&](long) {
+        Ray r = reflectedRay;
+        sink = r.hitsCollector(collector);
+    }) << endl;
+    cout << endl;
+
+    // Steady state of generate() on the default field and on a large ring field, counting and storing the
+    // rays, then through ENGINE_BOUNCES
+    int failures = 0;
+    for (int i = 0; i < 6; i++) {
+        int mode = i < 2 || i == 4 ? 1 : 0;
+        bool store = i < 4 && i % 2 == 1;
+        bool bounces = i >= 4;
+        RayTracer r(15, Point(0, 0, 0.4), Point(0.07, 0.07, 0.2), 100, 0.2, mode == 1 ? 0.6 : 3.0, 0.1, 0.2, 0);
+        r.setVerbose(false);
+        r.setup(mode, false);
+        r.setStoreRays(store);
+        if (bounces) {
+            r.setEngine(ENGINE_BOUNCES);
+        }
+        r.generate();
+
+        const int runs = 5;
+        long startAllocations = allocations, startBytes = allocatedBytes;
+        double ns = nsPerCall(runs, [&](long) {
+            r.generate();
+        });
+        long callAllocations = allocations - startAllocations;
+        cout << "RayTracer::generate() setup(" << mode << "), " << r.getNumOfPanels() << " panels" << (store ? ", stored rays: " : bounces ? ", ENGINE_BOUNCES: " : ": ") << ns / 1e6 << " ms, "
+            << (double)callAllocations / runs << " allocations, " << (double)(allocatedBytes - startBytes) / runs << " bytes per call" << (callAllocations > 0 ? " -- ALLOCATES" : "") << endl;
+        failures += callAllocations > 0;
+    }
+    cout << endl;
+
+    // With nothing but the panels and the collector the multi-bounce engine is the shaded grid plus the
+    // few paths reflected more than once, so the two must agree within their confidence intervals
+    for (int mode = 1; mode >= 0; mode--) {
+        float power[2], error[2];
+        for (int e = 0; e < 2; e++) {
+            RayTracer r(15, Point(0, 0, 0.4), Point(0.07, 0.07, 0.2), 100, 0.2, mode == 1 ? 0.6 : 3.0, 0.1, 0.2, 0);
+            r.setVerbose(false);
+            r.setup(mode, false);
+            r.setShading(true);
+            r.setEngine(e == 0 ? ENGINE_GRID : ENGINE_BOUNCES);
+            r.generate();
+            power[e] = r.getpowerAtCollector();
+            error[e] = r.getPowerErrorAtCollector();
+        }
+        bool same = fabs(power[1] - power[0]) <= sqrt(error[0] * error[0] + error[1] * error[1]);
+        cout << "ENGINE_BOUNCES setup(" << mode << "): " << power[1] << " W, ENGINE_GRID: " << power[0] << " W" << (same ? "" : " -- MISMATCH") << endl;
+        failures += !same;
+    }
+
+    // A reflector in the sun beside the field, aimed away from it, neither shades a panel nor reaches
+    // the collector, so the power must stay the same to the last digit (the grid does not change)
+    for (int mode = 1; mode >= 0; mode--) {
+        float rMax = mode == 1 ? 0.6 : 3.0;
+        float power[2];
+        for (int e = 0; e < 2; e++) {
+            RayTracer r(15, Point(0, 0, 0.4), Point(0.07, 0.07, 0.2), 100, 0.2, rMax, 0.1, 0.2, 0);
+            r.setVerbose(false);
+            r.setup(mode, false);
+            r.setShading(true);
+            r.setEngine(ENGINE_BOUNCES);
+            if (e == 1) {
+                Point center(0, -1.5 * rMax, 0);
+                Point source(center.getX() + sun.getDirection().getX(), center.getY() + sun.getDirection().getY(), center.getZ() + sun.getDirection().getZ());
+                r.addReflector(center, source, Point(0, -10 * rMax, 1), 0.3 * rMax);
+            }
+            r.generate();
+            power[e] = r.getpowerAtCollector();
+        }
+        bool same = power[1] == power[0];
+        cout << "ENGINE_BOUNCES setup(" << mode << ") with a reflector beside the field: " << power[1] << " W, without: " << power[0] << " W" << (same ? "" : " -- MISMATCH") << endl;
+        failures += !same;
+    }
+    return failures > 0 ? 1 : 0;
+}
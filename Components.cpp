@@ -9,7 +9,7 @@ Panel::Panel() {
     length = 0;
     powerContribution = 0;
 }
-Panel::Panel(Point iR, Vector sun, Point collector, float iLength) {
+Panel::Panel(const Point& iR, const Vector& sun, const Point& collector, float iLength) {
     R = iR;
     setNormal(sun, collector);
     equation.createPlane(normal, R);
@@ -20,7 +20,7 @@ Panel::Panel(Point iR, Vector sun, Point collector, float iLength) {
     minY = R.getY() - length / (float)2.0;
     powerContribution = 0;
 }
-Point Panel::getCenter() const { return R; }
+const Point& Panel::getCenter() const { return R; }
 float Panel::getX() const { return R.getX(); }
 float Panel::getY() const { return R.getY(); }
 float Panel::getZ() const { return R.getZ(); }
@@ -31,15 +31,15 @@ float Panel::getMinY() const { return minY; }
 float Panel::getLength() const { return length; }
 float& Panel::power() { return powerContribution; }
 
-Plane Panel::getPlane() const { return equation; }
-Vector Panel::getNormal() const { return normal; }
+const Plane& Panel::getPlane() const { return equation; }
+const Vector& Panel::getNormal() const { return normal; }
 Plane& Panel::getPlane() { return equation; }
 Vector& Panel::getNormal() { return normal; }
 float Panel::getNormalAngle() const {
     return normal.getAngle(Vector(0, 0, 1));
 }
 
-void Panel::printGnuplot(ofstream& panelFile) const {
+void Panel::printGnuplot(ostream& panelFile) const {
     float x1 = R.getX() + length / 2; float x2 = R.getX() - length / 2;
     float y1 = R.getY() + length / 2; float y2 = R.getY() - length / 2;
 
@@ -48,11 +48,11 @@ void Panel::printGnuplot(ofstream& panelFile) const {
     Point p3(x2, y2, equation.getZ(x2, y2)); // -10 -10
     Point p4(x1, y2, equation.getZ(x1, y2)); // 10 -10
 
-    panelFile << p1.getX() << " " << p1.getY() << " " << p1.getZ() << " " << p2.getX() - p1.getX() << " " << p2.getY() - p1.getY() << " " << p2.getZ() - p1.getZ() << endl;
-    panelFile << p2.getX() << " " << p2.getY() << " " << p2.getZ() << " " << p3.getX() - p2.getX() << " " << p3.getY() - p2.getY() << " " << p3.getZ() - p2.getZ() << endl;
-    panelFile << p3.getX() << " " << p3.getY() << " " << p3.getZ() << " " << p4.getX() - p3.getX() << " " << p4.getY() - p3.getY() << " " << p4.getZ() - p3.getZ() << endl;
-    panelFile << p4.getX() << " " << p4.getY() << " " << p4.getZ() << " " << p1.getX() - p4.getX() << " " << p1.getY() - p4.getY() << " " << p1.getZ() - p4.getZ() << endl;
-    panelFile << endl;
+    panelFile << p1.getX() << " " << p1.getY() << " " << p1.getZ() << " " << p2.getX() - p1.getX() << " " << p2.getY() - p1.getY() << " " << p2.getZ() - p1.getZ() << '\n';
+    panelFile << p2.getX() << " " << p2.getY() << " " << p2.getZ() << " " << p3.getX() - p2.getX() << " " << p3.getY() - p2.getY() << " " << p3.getZ() - p2.getZ() << '\n';
+    panelFile << p3.getX() << " " << p3.getY() << " " << p3.getZ() << " " << p4.getX() - p3.getX() << " " << p4.getY() - p3.getY() << " " << p4.getZ() - p3.getZ() << '\n';
+    panelFile << p4.getX() << " " << p4.getY() << " " << p4.getZ() << " " << p1.getX() - p4.getX() << " " << p1.getY() - p4.getY() << " " << p1.getZ() - p4.getZ() << '\n';
+    panelFile << '\n';
 }
 
 // ** Sun Class **
@@ -60,7 +60,11 @@ Sun::Sun(float time) {
     this->time = time;
     calcDirection();
 }
-Vector Sun::getDirection() const {
+Sun::Sun(float time, const Vector& direction) {
+    this->time = time;
+    this->direction = direction;
+}
+const Vector& Sun::getDirection() const {
     return direction;
 }
 float Sun::getTime() const {
@@ -78,7 +82,7 @@ float Sun::getNormalAngle() const {
 float Sun::getHorizonAngle() const {
     return getNormalAngle() + 90;
 }
-void Sun::printPath(float inc, float height, ofstream& sunFile) const {
+void Sun::printPath(float inc, float height, ostream& sunFile) const {
     for (float t = SUNRISE; t < SUNSET - inc; t += inc) {
         float temp = 3 * height;
         Sun currentS(t);
@@ -87,7 +91,7 @@ void Sun::printPath(float inc, float height, ofstream& sunFile) const {
         Vector nextV = nextS.direction * temp;
 
         sunFile << currentV.getX() << " " << currentV.getY() << " " << currentV.getZ() << " " <<
-            nextV.getX() - currentV.getX() << " " << nextV.getY() - currentV.getY() << " " << nextV.getZ() - currentV.getZ() << endl;
+            nextV.getX() - currentV.getX() << " " << nextV.getY() - currentV.getY() << " " << nextV.getZ() - currentV.getZ() << '\n';
     }
 }
 
@@ -137,7 +141,28 @@ Plane& Collector::getMaxZ() {
 Point& Collector::getCenter() {
     return center;
 }
-float Collector::calcTemperature(float power, float density, float mass, float specificHeat) {
+const Plane& Collector::getMinX() const {
+    return xMin;
+}
+const Plane& Collector::getMaxX() const {
+    return xMax;
+}
+const Plane& Collector::getMinY() const {
+    return yMin;
+}
+const Plane& Collector::getMaxY() const {
+    return yMax;
+}
+const Plane& Collector::getMinZ() const {
+    return zMin;
+}
+const Plane& Collector::getMaxZ() const {
+    return zMax;
+}
+const Point& Collector::getCenter() const {
+    return center;
+}
+float Collector::calcTemperature(float power, float density, float mass, float specificHeat) const {
     float volume = mass * density;
     //float volume = abs(xMax.getd() - xMin.getd()) * abs(yMax.getd() - yMin.getd()) * abs(zMax.getd() - zMin.getd());
     //float mass = volume * density; // kg
@@ -154,24 +179,24 @@ float Collector::getHeight() const {
     return height;
 }
 
-void Collector::printGnuplot(ofstream& collectorFile) const {
-    collectorFile << xMax.getd() << " " << yMax.getd() << " " << zMax.getd() << endl; // 1
-    collectorFile << xMax.getd() << " " << yMax.getd() << " " << zMin.getd() << endl; // 2
-    collectorFile << xMin.getd() << " " << yMax.getd() << " " << zMin.getd() << endl; // 3
-    collectorFile << xMin.getd() << " " << yMax.getd() << " " << zMax.getd() << endl; // 4
-    collectorFile << xMax.getd() << " " << yMax.getd() << " " << zMax.getd() << endl; // 5
-    collectorFile << xMax.getd() << " " << yMin.getd() << " " << zMax.getd() << endl; // 6
-    collectorFile << xMax.getd() << " " << yMin.getd() << " " << zMin.getd() << endl; // 7
-    collectorFile << xMax.getd() << " " << yMax.getd() << " " << zMin.getd() << endl; // 8
-    collectorFile << xMax.getd() << " " << yMin.getd() << " " << zMin.getd() << endl; // 9
-    collectorFile << xMin.getd() << " " << yMin.getd() << " " << zMin.getd() << endl; // 10
-    collectorFile << xMin.getd() << " " << yMax.getd() << " " << zMin.getd() << endl; // 11
-    collectorFile << xMin.getd() << " " << yMin.getd() << " " << zMin.getd() << endl; // 12
-    collectorFile << xMin.getd() << " " << yMin.getd() << " " << zMax.getd() << endl; // 13
-    collectorFile << xMax.getd() << " " << yMin.getd() << " " << zMax.getd() << endl; // 14
-    collectorFile << xMin.getd() << " " << yMin.getd() << " " << zMax.getd() << endl; // 15
-    collectorFile << xMin.getd() << " " << yMax.getd() << " " << zMax.getd() << endl; // 16
-    collectorFile << endl;
+void Collector::printGnuplot(ostream& collectorFile) const {
+    collectorFile << xMax.getd() << " " << yMax.getd() << " " << zMax.getd() << '\n'; // 1
+    collectorFile << xMax.getd() << " " << yMax.getd() << " " << zMin.getd() << '\n'; // 2
+    collectorFile << xMin.getd() << " " << yMax.getd() << " " << zMin.getd() << '\n'; // 3
+    collectorFile << xMin.getd() << " " << yMax.getd() << " " << zMax.getd() << '\n'; // 4
+    collectorFile << xMax.getd() << " " << yMax.getd() << " " << zMax.getd() << '\n'; // 5
+    collectorFile << xMax.getd() << " " << yMin.getd() << " " << zMax.getd() << '\n'; // 6
+    collectorFile << xMax.getd() << " " << yMin.getd() << " " << zMin.getd() << '\n'; // 7
+    collectorFile << xMax.getd() << " " << yMax.getd() << " " << zMin.getd() << '\n'; // 8
+    collectorFile << xMax.getd() << " " << yMin.getd() << " " << zMin.getd() << '\n'; // 9
+    collectorFile << xMin.getd() << " " << yMin.getd() << " " << zMin.getd() << '\n'; // 10
+    collectorFile << xMin.getd() << " " << yMax.getd() << " " << zMin.getd() << '\n'; // 11
+    collectorFile << xMin.getd() << " " << yMin.getd() << " " << zMin.getd() << '\n'; // 12
+    collectorFile << xMin.getd() << " " << yMin.getd() << " " << zMax.getd() << '\n'; // 13
+    collectorFile << xMax.getd() << " " << yMin.getd() << " " << zMax.getd() << '\n'; // 14
+    collectorFile << xMin.getd() << " " << yMin.getd() << " " << zMax.getd() << '\n'; // 15
+    collectorFile << xMin.getd() << " " << yMax.getd() << " " << zMax.getd() << '\n'; // 16
+    collectorFile << '\n';
 }
 
 // ** Other functions **
@@ -24,7 +24,7 @@ private:
     float powerContribution;
 
     // Returns the normal vector to the Panel
-    void setNormal(Vector sun, Point Q) {
+    void setNormal(const Vector& sun, const Point& Q) {
         Vector RQ(Q.getX() - R.getX(), Q.getY() - R.getY(), Q.getZ() - R.getZ());
         // Magnitudes:
         float SUNmag = sun.getMag();
@@ -38,9 +38,9 @@ private:
     }
 public:
     Panel();
-    Panel(Point iR, Vector sun, Point collector, float length);
+    Panel(const Point& iR, const Vector& sun, const Point& collector, float length);
 
-    Point getCenter() const;
+    const Point& getCenter() const;
     float getX() const;
     float getY() const;
     float getZ() const;
@@ -51,13 +51,13 @@ public:
     float getLength() const;
 
     float& power();
-    Plane getPlane() const;
-    Vector getNormal() const;
+    const Plane& getPlane() const;
+    const Vector& getNormal() const;
     Plane& getPlane();
     Vector& getNormal();
     float getNormalAngle() const;
 
-    void printGnuplot(ofstream& panelFile) const;
+    void printGnuplot(ostream& panelFile) const;
 };
 
 
@@ -109,12 +109,13 @@ private:
     }
 public:
     Sun(float time);
+    Sun(float time, const Vector& direction); // A sun along any direction; time only places the plane the rays start from
     Sun() { time = 0; }
-    Vector getDirection() const;
+    const Vector& getDirection() const;
     float getTime() const;
     float getNormalAngle() const; // Must return in degrees
     float getHorizonAngle() const; // Must return in degrees
-    void printPath(float inc, float height, ofstream& sunFile) const;
+    void printPath(float inc, float height, ostream& sunFile) const;
 };
 
 class Collector {
@@ -133,12 +134,19 @@ public:
     Plane& getMinZ();
     Plane& getMaxZ();
     Point& getCenter();
-    float calcTemperature(float power, float density, float mass, float specificHeat);
+    const Plane& getMinX() const;
+    const Plane& getMaxX() const;
+    const Plane& getMinY() const;
+    const Plane& getMaxY() const;
+    const Plane& getMinZ() const;
+    const Plane& getMaxZ() const;
+    const Point& getCenter() const;
+    float calcTemperature(float power, float density, float mass, float specificHeat) const;
 
     float getLength() const;
     float getWidth() const;
     float getHeight() const;
-    void printGnuplot(ofstream& collectorFile) const;
+    void printGnuplot(ostream& collectorFile) const;
 };
 
 ostream& operator<<(ostream& out, const Panel& panel);
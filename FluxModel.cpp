@@ -0,0 +1,115 @@
+#ifndef FluxModel_cpp
+#define FluxModel_cpp
+
+#include "FluxModel.h"
+
+// Integral of the standard normal distribution function: d/dz (z * Phi(z) + phi(z)) = Phi(z)
+static double integrateNormal(double z) {
+    return z * 0.5 * erfc(-z / sqrt(2.0)) + exp(-z * z / 2) / sqrt(2 * PI);
+}
+
+// Share of a uniform strip of half width image, blurred by a Gaussian of deviation sigma, that falls
+// inside [-half, half] when the strip is centred at -offset
+static double getStripIntercept(double offset, double half, double image, double sigma) {
+    if (sigma <= 1e-12 * (half + image)) { // Overlap of the two intervals
+        double overlap = fmin(half, -offset + image) - fmax(-half, -offset - image);
+        return image > 0 ? fmax(overlap, 0) / (2 * image) : (fabs(offset) <= half ? 1 : 0);
+    }
+    if (image <= 1e-6 * sigma) { // A Gaussian spot
+        return (erf((half - offset) / (sqrt(2.0) * sigma)) + erf((half + offset) / (sqrt(2.0) * sigma))) / 2;
+    }
+    double upper = half - offset, lower = -half - offset;
+    double sum = integrateNormal((upper + image) / sigma) - integrateNormal((upper - image) / sigma) - integrateNormal((lower + image) / sigma) + integrateNormal((lower - image) / sigma);
+    return fmin(fmax(sigma * sum / (2 * image), 0), 1);
+}
+
+// ** FluxModel Class **
+FluxModel::FluxModel() {
+    sunSigma = FLUX_SUN_SIGMA;
+    slopeError = FLUX_SLOPE_ERROR;
+    spread = FLUX_SPREAD;
+}
+void FluxModel::setSunSigma(float sunSigma) {
+    this->sunSigma = sunSigma;
+}
+void FluxModel::setSlopeError(float slopeError) {
+    this->slopeError = slopeError;
+}
+void FluxModel::setSpread(float spread) {
+    this->spread = spread;
+}
+float FluxModel::getSunSigma() const {
+    return sunSigma;
+}
+float FluxModel::getSlopeError() const {
+    return slopeError;
+}
+float FluxModel::getSpread() const {
+    return spread;
+}
+
+double FluxModel::getIntercept(const Panel& panel, const Vector& sunVec, const Collector& collector) const {
+    const Plane& plane = panel.getPlane();
+    double n[3] = { panel.getNormal().getX(), panel.getNormal().getY(), panel.getNormal().getZ() };
+    double sunMag = sunVec.getMag();
+    double v[3] = { sunVec.getX() / sunMag, sunVec.getY() / sunMag, sunVec.getZ() / sunMag };
+    double cosine = -(v[0] * n[0] + v[1] * n[1] + v[2] * n[2]) / sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+    if (fabs(plane.getc()) < 1e-6 || !(cosine > 0)) {
+        return 0; // Vertical or facing away from the sun, as in traceBeams
+    }
+
+    // Reflected direction and the plane across it
+    double scale = -2 * cosine / sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+    double r[3] = { v[0] - scale * n[0], v[1] - scale * n[1], v[2] - scale * n[2] };
+    double e1[3], e2[3];
+    getProjectionBasis(r, e1, e2);
+
+    // Image of the mirror: the panel quad seen along r. Along each direction of the spot it is taken as
+    // a uniform strip with the variance of the projected quad ((a.e)^2 + (b.e)^2) / 12
+    double length = panel.getLength();
+    double a[3] = { length, 0, plane.getZ(panel.getMaxX(), panel.getY()) - plane.getZ(panel.getMinX(), panel.getY()) };
+    double b[3] = { 0, length, plane.getZ(panel.getX(), panel.getMaxY()) - plane.getZ(panel.getX(), panel.getMinY()) };
+    double a1 = a[0] * e1[0] + a[1] * e1[1] + a[2] * e1[2], a2 = a[0] * e2[0] + a[1] * e2[1] + a[2] * e2[2];
+    double b1 = b[0] * e1[0] + b[1] * e1[1] + b[2] * e1[2], b2 = b[0] * e2[0] + b[1] * e2[1] + b[2] * e2[2];
+    double image1 = sqrt((a1 * a1 + b1 * b1) / 4), image2 = sqrt((a2 * a2 + b2 * b2) / 4); // Half widths of the strips
+
+    // The spot is centred where the reflection of the panel center passes the collector, which is its
+    // center only while the panel is aimed for this sun
+    const Point& target = collector.getCenter();
+    const Point& center = panel.getCenter();
+    double toTarget[3] = { target.getX() - center.getX(), target.getY() - center.getY(), target.getZ() - center.getZ() };
+    double range = toTarget[0] * r[0] + toTarget[1] * r[1] + toTarget[2] * r[2];
+    if (range <= 0) {
+        return 0; // The collector is behind the reflected light
+    }
+    double o1 = toTarget[0] * e1[0] + toTarget[1] * e1[1] + toTarget[2] * e1[2];
+    double o2 = toTarget[0] * e2[0] + toTarget[1] * e2[1] + toTarget[2] * e2[2];
+
+    // The sun shape and the slope error (doubled by the reflection) spread over the slant range
+    double sigma = spread * range * sqrt(sunSigma * sunSigma + 4 * slopeError * slopeError);
+
+    // The collector box seen along the reflected direction: the rectangle bounding its silhouette, shrunk
+    // to the area of the silhouette (the faces facing r)
+    double half[3] = { collector.getLength() / 2, collector.getWidth() / 2, collector.getHeight() / 2 };
+    double h1 = 0, h2 = 0;
+    for (int i = 0; i < 3; i++) {
+        h1 += half[i] * fabs(e1[i]);
+        h2 += half[i] * fabs(e2[i]);
+    }
+    double area = 4 * (half[1] * half[2] * fabs(r[0]) + half[0] * half[2] * fabs(r[1]) + half[0] * half[1] * fabs(r[2]));
+    double shrink = sqrt(area / (4 * h1 * h2));
+    h1 *= shrink;
+    h2 *= shrink;
+    return getStripIntercept(o1, h1, image1, sigma) * getStripIntercept(o2, h2, image2, sigma);
+}
+
+void FluxModel::estimate(const Sun& sun, const Collector& collector, const vector<Panel>& panels, TraceCounts& counts) const {
+    Vector sunVec = sun.getDirection() * -1;
+    counts.reset(panels.size());
+    counts.panelFractions.resize(panels.size());
+    for (size_t p = 0; p < panels.size(); p++) {
+        counts.panelFractions[p] = getIntercept(panels[p], sunVec, collector);
+    }
+}
+
+#endif
@@ -0,0 +1,42 @@
+#ifndef FluxModel_h
+#define FluxModel_h
+
+#include <vector>
+#include "Analytic.h" // Also gets Ray.h, Position.h and Components.h
+
+#define FLUX_SUN_SIGMA 0.00233 // rad, standard deviation of the sun shape (half the angular radius of the disk)
+#define FLUX_SLOPE_ERROR 0 // rad, standard deviation of the mirror normals
+#define FLUX_SPREAD 1 // Scale of the spot widths; fitted by RayTracer::calibrateFluxModel
+#define FLUX_SPREAD_MIN 0.05 // Range searched by the calibration
+#define FLUX_SPREAD_MAX 20
+#define FLUX_CALIBRATION_STEPS 40
+
+using namespace std;
+
+// HFLCAL style flux model: the reflected image of every panel is the panel quad seen along the reflected
+// direction, convolved with a Gaussian for the sun shape and slope error spread over the slant range
+// (its deviation scaled by spread). The spot is centred where the reflection of the panel center passes
+// the collector, and the intercept is its share over the projected box of the collector, in closed form
+// along the two directions across the reflection. It costs a few operations per panel and uses no rays.
+class FluxModel {
+private:
+    float sunSigma;
+    float slopeError;
+    float spread;
+public:
+    FluxModel();
+    void setSunSigma(float sunSigma);
+    void setSlopeError(float slopeError);
+    void setSpread(float spread);
+    float getSunSigma() const;
+    float getSlopeError() const;
+    float getSpread() const;
+
+    // Fraction of the light reflected by the panel that reaches the collector; 0 if it faces away from the sun
+    double getIntercept(const Panel& panel, const Vector& sunVec, const Collector& collector) const;
+
+    // Fills counts.panelFractions with the intercept of every panel, like traceAnalytic
+    void estimate(const Sun& sun, const Collector& collector, const vector<Panel>& panels, TraceCounts& counts) const;
+};
+
+#endif
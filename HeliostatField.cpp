@@ -0,0 +1,95 @@
+#ifndef HeliostatField_cpp
+#define HeliostatField_cpp
+
+#include "HeliostatField.h"
+
+// ** HeliostatField Class **
+HeliostatField::HeliostatField() {}
+void HeliostatField::clear() {
+    cx.clear(); cy.clear(); cz.clear();
+    nx.clear(); ny.clear(); nz.clear();
+    d.clear();
+    minX.clear(); maxX.clear(); minY.clear(); maxY.clear();
+}
+void HeliostatField::assign(const vector<Panel>& panels) {
+    clear();
+    for (vector<Panel>::const_iterator panelIdx = panels.begin(); panelIdx != panels.end(); panelIdx++) {
+        cx.push_back(panelIdx->getX());
+        cy.push_back(panelIdx->getY());
+        cz.push_back(panelIdx->getZ());
+        nx.push_back(panelIdx->getNormal().getX());
+        ny.push_back(panelIdx->getNormal().getY());
+        nz.push_back(panelIdx->getNormal().getZ());
+        d.push_back(panelIdx->getPlane().getd());
+        minX.push_back(panelIdx->getMinX());
+        maxX.push_back(panelIdx->getMaxX());
+        minY.push_back(panelIdx->getMinY());
+        maxY.push_back(panelIdx->getMaxY());
+    }
+}
+int HeliostatField::size() const {
+    return cx.size();
+}
+
+// The magnitudes of Vector::getMag are pow(x, 0.5) in double rounded to float, which is sqrtf(x) for every float
+void HeliostatField::aim(const Vector& sun, const Point& target) {
+    float sunMag = sun.getMag();
+    float ux = sun.getX() / sunMag, uy = sun.getY() / sunMag, uz = sun.getZ() / sunMag;
+    float qx = target.getX(), qy = target.getY(), qz = target.getZ();
+
+    int n = size();
+    int i = 0;
+#if defined(__AVX__)
+    __m256 vux = _mm256_set1_ps(ux), vuy = _mm256_set1_ps(uy), vuz = _mm256_set1_ps(uz);
+    __m256 vqx = _mm256_set1_ps(qx), vqy = _mm256_set1_ps(qy), vqz = _mm256_set1_ps(qz);
+    for (; i + 8 <= n; i += 8) {
+        __m256 rx = _mm256_loadu_ps(&cx[i]), ry = _mm256_loadu_ps(&cy[i]), rz = _mm256_loadu_ps(&cz[i]);
+        __m256 tx = _mm256_sub_ps(vqx, rx), ty = _mm256_sub_ps(vqy, ry), tz = _mm256_sub_ps(vqz, rz);
+        __m256 mag = _mm256_sqrt_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(tx, tx), _mm256_mul_ps(ty, ty)), _mm256_mul_ps(tz, tz)));
+        tx = _mm256_add_ps(vux, _mm256_div_ps(tx, mag));
+        ty = _mm256_add_ps(vuy, _mm256_div_ps(ty, mag));
+        tz = _mm256_add_ps(vuz, _mm256_div_ps(tz, mag));
+        mag = _mm256_sqrt_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(tx, tx), _mm256_mul_ps(ty, ty)), _mm256_mul_ps(tz, tz)));
+        tx = _mm256_div_ps(tx, mag);
+        ty = _mm256_div_ps(ty, mag);
+        tz = _mm256_div_ps(tz, mag);
+        _mm256_storeu_ps(&nx[i], tx);
+        _mm256_storeu_ps(&ny[i], ty);
+        _mm256_storeu_ps(&nz[i], tz);
+        _mm256_storeu_ps(&d[i], _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(tx, rx), _mm256_mul_ps(ty, ry)), _mm256_mul_ps(tz, rz)));
+    }
+#endif
+    for (; i < n; i++) {
+        float tx = qx - cx[i], ty = qy - cy[i], tz = qz - cz[i];
+        float mag = sqrtf(tx * tx + ty * ty + tz * tz);
+        tx = ux + tx / mag;
+        ty = uy + ty / mag;
+        tz = uz + tz / mag;
+        mag = sqrtf(tx * tx + ty * ty + tz * tz);
+        nx[i] = tx / mag;
+        ny[i] = ty / mag;
+        nz[i] = tz / mag;
+        d[i] = nx[i] * cx[i] + ny[i] * cy[i] + nz[i] * cz[i];
+    }
+}
+
+void HeliostatField::store(vector<Panel>& panels) const {
+    for (int i = 0; i < size(); i++) {
+        panels[i].getNormal() = Vector(nx[i], ny[i], nz[i]);
+        panels[i].getPlane() = Plane(nx[i], ny[i], nz[i], d[i]);
+    }
+}
+
+const float* HeliostatField::getCenterX() const { return cx.data(); }
+const float* HeliostatField::getCenterY() const { return cy.data(); }
+const float* HeliostatField::getCenterZ() const { return cz.data(); }
+const float* HeliostatField::getNormalX() const { return nx.data(); }
+const float* HeliostatField::getNormalY() const { return ny.data(); }
+const float* HeliostatField::getNormalZ() const { return nz.data(); }
+const float* HeliostatField::getPlaneD() const { return d.data(); }
+const float* HeliostatField::getMinX() const { return minX.data(); }
+const float* HeliostatField::getMaxX() const { return maxX.data(); }
+const float* HeliostatField::getMinY() const { return minY.data(); }
+const float* HeliostatField::getMaxY() const { return maxY.data(); }
+
+#endif
@@ -0,0 +1,46 @@
+#ifndef HeliostatField_h
+#define HeliostatField_h
+
+#include <vector>
+#include "Components.h" // Also gets Position.h
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+// Structure of arrays of the panels of a field: centers, normals, plane offsets and bounds in
+// contiguous arrays. aim() turns every panel towards a new sun in place with the arithmetic of
+// Panel::setNormal and Plane::createPlane, so a re-aimed field is the field setup() would build.
+class HeliostatField {
+private:
+    vector<float> cx, cy, cz; // Centers
+    vector<float> nx, ny, nz; // Unit normals (a, b, c of the planes)
+    vector<float> d;          // Planes: nx * x + ny * y + nz * z = d
+    vector<float> minX, maxX, minY, maxY;
+public:
+    HeliostatField();
+    void clear();
+    void assign(const vector<Panel>& panels); // Copies the layout and the current aim of the panels
+    int size() const;
+
+    // Re-aims every panel so it reflects rays along sun onto target. Nothing is allocated.
+    void aim(const Vector& sun, const Point& target);
+    // Writes the normals and planes into the panels the field was assigned from
+    void store(vector<Panel>& panels) const;
+
+    const float* getCenterX() const;
+    const float* getCenterY() const;
+    const float* getCenterZ() const;
+    const float* getNormalX() const;
+    const float* getNormalY() const;
+    const float* getNormalZ() const;
+    const float* getPlaneD() const;
+    const float* getMinX() const;
+    const float* getMaxX() const;
+    const float* getMinY() const;
+    const float* getMaxY() const;
+};
+
+#endif
@@ -58,37 +58,37 @@ float Vector::getZ() const {
 float Vector::getMag() const {
     return (float)pow(x * x + y * y + z * z, 0.5);
 }
-float Vector::dot(Vector v) const {
+float Vector::dot(const Vector& v) const {
     return x * v.x + y * v.y + z * v.z;
 }
-float Vector::getAngle(Vector v) const {
+float Vector::getAngle(const Vector& v) const {
     float x = dot(v) / (getMag() * v.getMag());
     if (x > 1)
         return 0;
     return acos(x);
 }
-Vector Vector::getUnit() {
+Vector Vector::getUnit() const {
     Vector unit = *this / getMag();
     return unit;
 }
-Vector Vector::operator+(Vector vec) {
+Vector Vector::operator+(const Vector& vec) const {
     float rx, ry, rz; // Coordinates of result
     rx = x + vec.x;
     ry = y + vec.y;
     rz = z + vec.z;
     return Vector(rx, ry, rz);
 }
-Vector Vector::operator*(float num) {
+Vector Vector::operator*(float num) const {
     return Vector(x * num, y * num, z * num);
 }
-Vector Vector::operator/(float num) {
+Vector Vector::operator/(float num) const {
     return Vector(x / num, y / num, z / num);
 }
 
 // ** Plane Class **
 Plane::Plane(float ia, float ib, float ic, float id)
     :a(ia), b(ib), c(ic), d(id) {}
-void Plane::createPlane(Vector normal, Point point) {
+void Plane::createPlane(const Vector& normal, const Point& point) {
     a = normal.getX();
     b = normal.getY();
     c = normal.getZ();
@@ -112,7 +112,7 @@ float Plane::getZ(float x, float y) const {
 
 // ** Line Class **
 Line::Line() {}
-Line::Line(Point point1, Point point2) {
+Line::Line(const Point& point1, const Point& point2) {
     direction = Vector(point1.getX() - point2.getX(), point1.getY() - point2.getY(), point1.getZ() - point2.getZ());
     point = Vector(point1.getX(), point1.getY(), point1.getZ());
 }
@@ -122,19 +122,19 @@ Vector& Line::getPointVector() {
 Vector& Line::getDirectionVector() {
     return direction;
 }
-Vector Line::getPointVector() const {
+const Vector& Line::getPointVector() const {
     return point;
 }
-Vector Line::getDirectionVector() const {
+const Vector& Line::getDirectionVector() const {
     return direction;
 }
-Point Line::getPointOfLine(float t) {
+Point Line::getPointOfLine(float t) const {
     Vector r = point + direction * t;
     return Point(r.getX(), r.getY(), r.getZ());
 }
 
 // ** Other functions **
-Point getIntersection(Line line, Plane plane) {
+Point getIntersection(const Line& line, const Plane& plane) {
     // Line:
     // point = <px, py, pz>
     // direction = <dx, dy, dz>
@@ -158,7 +158,7 @@ float distance(const Point& p1, const Point& p2) {
     return (float)pow(pow(p1.getX() - p2.getX(), 2.0) + pow(p1.getY() - p2.getY(), 2.0) + pow(p1.getZ() - p2.getZ(), 2.0), 0.5);
 }
 
-Vector getProjection(Vector a, Vector b) { // Projection of a onto b
+Vector getProjection(const Vector& a, const Vector& b) { // Projection of a onto b
     return b * (a.dot(b) / b.dot(b));
 }
 
@@ -34,14 +34,14 @@ public:
     float getY() const;
     float getZ() const;
     float getMag() const;
-    float dot(Vector v) const;
-    float getAngle(Vector v) const;
+    float dot(const Vector& v) const;
+    float getAngle(const Vector& v) const;
 
-    Vector getUnit();
+    Vector getUnit() const;
 
-    Vector operator+(Vector vec);
-    Vector operator*(float num);
-    Vector operator/(float num);
+    Vector operator+(const Vector& vec) const;
+    Vector operator*(float num) const;
+    Vector operator/(float num) const;
 };
 
 class Plane {
@@ -50,7 +50,7 @@ private:
     float a, b, c, d;
 public:
     Plane(float ia = 0, float ib = 0, float ic = 0, float id = 0);
-    void createPlane(Vector normal, Point point);
+    void createPlane(const Vector& normal, const Point& point);
     float geta() const;
     float getb() const;
     float getc() const;
@@ -66,18 +66,18 @@ private:
     Vector point;
 public:
     Line();
-    Line(Point point1, Point point2);
+    Line(const Point& point1, const Point& point2);
     Vector& getPointVector();
     Vector& getDirectionVector();
-    Vector getPointVector() const;
-    Vector getDirectionVector() const;
-    Point getPointOfLine(float t);
+    const Vector& getPointVector() const;
+    const Vector& getDirectionVector() const;
+    Point getPointOfLine(float t) const;
 };
 
-Point getIntersection(Line line, Plane plane);
+Point getIntersection(const Line& line, const Plane& plane);
 Point midPoint(const Point& p1, const Point& p2);
 float distance(const Point& p1, const Point& p2);
-Vector getProjection(Vector a, Vector b);
+Vector getProjection(const Vector& a, const Vector& b);
 
 ostream& operator<<(ostream& out, const Point& p);
 ostream& operator<<(ostream& out, const Vector& vec);
@@ -3,11 +3,11 @@
 
 #include "Ray.h"
 
-float height;
+float height; // Height of the sun plane of the last stored trace; used to draw the rays
 
 // ** Ray Class **
 Ray::Ray() { reflected = false; panelled = false; collectored = false; }
-Ray::Ray(Point center, Point point) {
+Ray::Ray(const Point& center, const Point& point) {
     reflected = false;
     collectored = false;
     panelled = false;
@@ -15,7 +15,7 @@ Ray::Ray(Point center, Point point) {
     line = Line(center, point);
     vector = Vector(point.getX() - center.getX(), point.getY() - center.getY(), point.getZ() - center.getZ());
 }
-Ray::Ray(Vector ivector, Line iline) {
+Ray::Ray(const Vector& ivector, const Line& iline) {
     vector = ivector;
     line = iline;
 
@@ -26,9 +26,15 @@ Ray::Ray(Vector ivector, Line iline) {
 Line& Ray::getLine() {
     return line;
 }
+const Line& Ray::getLine() const {
+    return line;
+}
 Vector& Ray::getVector() {
     return vector;
 }
+const Vector& Ray::getVector() const {
+    return vector;
+}
 
 bool Ray::getReflected() const {
     return reflected;
@@ -40,122 +46,290 @@ bool Ray::getPanelled() const {
     return panelled;
 }
 
-Point Ray::getPanelPoint() const {
+const Point& Ray::getSunPoint() const {
+    return sunPoint;
+}
+const Point& Ray::getPanelPoint() const {
     return panelPoint;
 }
-Point Ray::getCollectorPoint() const {
+const Point& Ray::getCollectorPoint() const {
     return collectorPoint;
 }
-bool Ray::hitsPanel(Panel panel) {
-    Point intersection = getIntersection(line, panel.getPlane());
+bool Ray::intersectsPanel(const Panel& panel, Point& intersection) const {
+    intersection = getIntersection(line, panel.getPlane());
     if (intersection.getX() <= panel.getMaxX() && intersection.getX() >= panel.getMinX() && intersection.getY() <= panel.getMaxY() && intersection.getY() >= panel.getMinY()) {
         if (panel.getNormal().dot(vector) < 0) { // If n.v < 0, then the two vectors are pointing to each other
-            panelPoint = intersection;
-            panelled = true;
             return true;
         }
     }
     return false;
 }
+bool Ray::hitsPanel(const Panel& panel) {
+    Point intersection;
+    if (intersectsPanel(panel, intersection)) {
+        setPanelPoint(intersection);
+        return true;
+    }
+    return false;
+}
+void Ray::setPanelPoint(const Point& intersection) {
+    panelPoint = intersection;
+    panelled = true;
+}
 // Creates new reflected ray after the ray hits the panel 
-bool Ray::reflect(Panel panel, Ray& reflectedRay) {
+bool Ray::reflect(const Panel& panel, Ray& reflectedRay) {
     if (!hitsPanel(panel)) {
         return false;
     }
+    reflectAt(panel, reflectedRay);
+    return true;
+}
+// The intersection recorded by hitsPanel/setPanelPoint is reused instead of being computed again
+void Ray::reflectAt(const Panel& panel, Ray& reflectedRay) const {
     reflectedRay = *this;
     reflectedRay.reflected = true;
-    Point intersection = getIntersection(line, panel.getPlane());
+    const Point& intersection = panelPoint;
 
     // Reflected vector V = V - 2 * ( Proj of V onto n ) = V - 2 * ( V.n ) / ( n.n ) * n .... V is the vector of the ray coming from the sun, n is normal to the panel
     reflectedRay.vector = vector + getProjection(vector, panel.getNormal()) * -2;
     // Two points of the line: the point of intersection with panel, and the vector added to the point of intersection
     reflectedRay.line = Line(Point(reflectedRay.vector.getX() + intersection.getX(), reflectedRay.vector.getY() + intersection.getY(), reflectedRay.vector.getZ() + intersection.getZ()), intersection);
+}
+bool Ray::hitsCollector(const Collector& collector) {
+    BoxCrossing crossing;
+    intersectCollector(line.getPointVector(), line.getDirectionVector(), collector, crossing);
+    return hitsCollector(crossing);
+}
+bool Ray::hitsCollector(const BoxCrossing& crossing) {
+    if (crossing.enterFace < 0) {
+        return collectored;
+    }
+    // The whole line is tested, so the box may also lie behind the panel; the crossing nearest to the
+    // panel point is kept, and on a tie the face that comes first
+    const Vector& point = line.getPointVector();
+    const Vector& direction = line.getDirectionVector();
+    Point enter(point.getX() + crossing.tEnter * direction.getX(), point.getY() + crossing.tEnter * direction.getY(), point.getZ() + crossing.tEnter * direction.getZ());
+    Point exit(point.getX() + crossing.tExit * direction.getX(), point.getY() + crossing.tExit * direction.getY(), point.getZ() + crossing.tExit * direction.getZ());
+    float enterDistance = distance(panelPoint, enter), exitDistance = distance(panelPoint, exit);
+    bool useExit = exitDistance < enterDistance || (exitDistance == enterDistance && crossing.exitFace < crossing.enterFace);
+    collectorPoint = useExit ? exit : enter;
+    collectored = true;
     return true;
 }
-bool Ray::hitsCollector(Collector collector) {
-    float minX = collector.getMinX().getd();
-    float maxX = collector.getMaxX().getd();
-    float minY = collector.getMinY().getd();
-    float maxY = collector.getMaxY().getd();
-    float minZ = collector.getMinZ().getd();
-    float maxZ = collector.getMaxZ().getd();
+void Ray::getSegment(float* segment) const {
+    float distance = 1.5 * height;
+    if (!panelled) {
+        segment[0] = sunPoint.getX(); segment[1] = sunPoint.getY(); segment[2] = sunPoint.getZ();
+        segment[3] = distance * vector.getX(); segment[4] = distance * vector.getY(); segment[5] = distance * vector.getZ();
+    }
+    else if (reflected) {
+        segment[0] = panelPoint.getX(); segment[1] = panelPoint.getY(); segment[2] = panelPoint.getZ();
+        if (collectored) {
+            segment[3] = collectorPoint.getX() - panelPoint.getX(); segment[4] = collectorPoint.getY() - panelPoint.getY(); segment[5] = collectorPoint.getZ() - panelPoint.getZ();
+        }
+        else {
+            segment[3] = distance * vector.getX(); segment[4] = distance * vector.getY(); segment[5] = distance * vector.getZ();
+        }
+    }
+    else { // Hits Panel
+        segment[0] = sunPoint.getX(); segment[1] = sunPoint.getY(); segment[2] = sunPoint.getZ();
+        segment[3] = panelPoint.getX() - sunPoint.getX(); segment[4] = panelPoint.getY() - sunPoint.getY(); segment[5] = panelPoint.getZ() - sunPoint.getZ();
+    }
+}
+void Ray::printGnuplot(ostream& file) const {
+    float segment[6];
+    getSegment(segment);
+    file << segment[0] << " " << segment[1] << " " << segment[2] << " " << segment[3] << " " << segment[4] << " " << segment[5] << '\n';
+}
 
-    bool hitArr[6] = { false, false, false, false, false, false };
-    Point intersections[6];
+// ** RayRecord Class **
+RayRecord::RayRecord(const Ray& ray, int panel) {
+    state = (ray.getPanelled() ? RAY_PANELLED : 0) | (ray.getReflected() ? RAY_REFLECTED : 0) | (ray.getCollectored() ? RAY_COLLECTORED : 0);
+    state |= (uint32_t)(panel + 1) << RAY_STATE_BITS;
 
-    Point planeMinX = getIntersection(line, collector.getMinX());
-    intersections[0] = planeMinX;
-    if (planeMinX.getY() <= maxY && planeMinX.getY() >= minY && planeMinX.getZ() <= maxZ && planeMinX.getZ() >= minZ) {
-        hitArr[0] = true;
+    // The differences are taken here exactly as Ray::getSegment takes them, so the drawn segments do not change
+    const Point& start = !ray.getPanelled() || !ray.getReflected() ? ray.getSunPoint() : ray.getPanelPoint();
+    origin[0] = start.getX(); origin[1] = start.getY(); origin[2] = start.getZ();
+    const Vector& vector = ray.getVector();
+    direction[0] = vector.getX(); direction[1] = vector.getY(); direction[2] = vector.getZ();
+    if (ray.getPanelled() && !ray.getReflected()) {
+        const Point& end = ray.getPanelPoint();
+        direction[0] = end.getX() - start.getX(); direction[1] = end.getY() - start.getY(); direction[2] = end.getZ() - start.getZ();
     }
-    Point planeMaxX = getIntersection(line, collector.getMaxX());
-    intersections[1] = planeMaxX;
-    if (planeMaxX.getY() <= maxY && planeMaxX.getY() >= minY && planeMaxX.getZ() <= maxZ && planeMaxX.getZ() >= minZ) {
-        hitArr[1] = true;
+    else if (ray.getPanelled() && ray.getCollectored()) {
+        const Point& end = ray.getCollectorPoint();
+        direction[0] = end.getX() - start.getX(); direction[1] = end.getY() - start.getY(); direction[2] = end.getZ() - start.getZ();
     }
-    Point planeMinY = getIntersection(line, collector.getMinY());
-    intersections[2] = planeMinY;
-    if (planeMinY.getX() <= maxX && planeMinY.getX() >= minX && planeMinY.getZ() <= maxZ && planeMinY.getZ() >= minZ) {
-        hitArr[2] = true;
-    }
-    Point planeMaxY = getIntersection(line, collector.getMaxY());
-    intersections[3] = planeMaxY;
-    if (planeMaxY.getX() <= maxX && planeMaxY.getX() >= minX && planeMaxY.getZ() <= maxZ && planeMaxY.getZ() >= minZ) {
-        hitArr[3] = true;
+}
+bool RayRecord::getPanelled() const {
+    return state & RAY_PANELLED;
+}
+bool RayRecord::getReflected() const {
+    return state & RAY_REFLECTED;
+}
+bool RayRecord::getCollectored() const {
+    return state & RAY_COLLECTORED;
+}
+int RayRecord::getPanel() const {
+    return (int)(state >> RAY_STATE_BITS) - 1;
+}
+void RayRecord::getSegment(float* segment) const {
+    segment[0] = origin[0]; segment[1] = origin[1]; segment[2] = origin[2];
+    bool bounded = getPanelled() && (!getReflected() || getCollectored());
+    if (bounded) {
+        segment[3] = direction[0]; segment[4] = direction[1]; segment[5] = direction[2];
     }
-    Point planeMinZ = getIntersection(line, collector.getMinZ());
-    intersections[4] = planeMinZ;
-    if (planeMinZ.getX() <= maxX && planeMinZ.getX() >= minX && planeMinZ.getY() <= maxY && planeMinZ.getY() >= minY) {
-        hitArr[4] = true;
+    else {
+        float distance = 1.5 * height;
+        segment[3] = distance * direction[0]; segment[4] = distance * direction[1]; segment[5] = distance * direction[2];
     }
-    Point planeMaxZ = getIntersection(line, collector.getMaxZ());
-    intersections[5] = planeMaxZ;
-    if (planeMaxZ.getX() <= maxX && planeMaxZ.getX() >= minX && planeMaxZ.getY() <= maxY && planeMaxZ.getY() >= minY) {
-        hitArr[5] = true;
+}
+void RayRecord::printGnuplot(ostream& file) const {
+    float segment[6];
+    getSegment(segment);
+    file << segment[0] << " " << segment[1] << " " << segment[2] << " " << segment[3] << " " << segment[4] << " " << segment[5] << '\n';
+}
+
+// ** TraceCounts Class **
+void TraceCounts::reset(int numOfPanels) {
+    hitPanel = missPanel = hitCollector = missCollector = shaded = blocked = 0;
+    panelHits.assign(numOfPanels, 0);
+    panelCollectorHits.assign(numOfPanels, 0);
+    bounces.reset(0, 0);
+    panelFractions.clear();
+}
+
+void TraceCounts::add(const TraceCounts& other) {
+    hitPanel += other.hitPanel;
+    missPanel += other.missPanel;
+    hitCollector += other.hitCollector;
+    missCollector += other.missCollector;
+    shaded += other.shaded;
+    blocked += other.blocked;
+    bounces.add(other.bounces);
+    for (size_t i = 0; i < panelHits.size() && i < other.panelHits.size(); i++) {
+        panelHits[i] += other.panelHits[i];
+        panelCollectorHits[i] += other.panelCollectorHits[i];
     }
+}
 
-    float minDistance = (float)INT_MAX;
-    int minIndex = 0;
+// ** BounceCounts Class **
+void BounceCounts::reset(int numOfReceivers, int maxBounces) {
+    rays = reflectorHits = reflectorShaded = direct = backHits = truncated = 0;
+    absorbed = lost = 0;
+    receiverHits.assign(numOfReceivers, 0);
+    receiverEnergy.assign(numOfReceivers, 0);
+    receiverEnergySq.assign(numOfReceivers, 0);
+    reflectorEnergy.assign(numOfReceivers, 0);
+    reflectorEnergySq.assign(numOfReceivers, 0);
+    bounceHits.assign(maxBounces > 0 ? maxBounces + 1 : 0, 0); // Nothing to allocate for the other tracers
+}
 
-    for (int i = 0; i < 6; i++) {
-        if (hitArr[i]) {
-            float currentDistance = distance(Point(panelPoint.getX(), panelPoint.getY(), panelPoint.getZ()), intersections[i]);
-            if (currentDistance < minDistance) {
-                minDistance = currentDistance;
-                minIndex = i;
-            }
-            collectored = true;
-        }
+void BounceCounts::add(const BounceCounts& other) {
+    if (receiverHits.size() < other.receiverHits.size()) {
+        receiverHits.resize(other.receiverHits.size(), 0);
+        receiverEnergy.resize(other.receiverEnergy.size(), 0);
+        receiverEnergySq.resize(other.receiverEnergySq.size(), 0);
+        reflectorEnergy.resize(other.reflectorEnergy.size(), 0);
+        reflectorEnergySq.resize(other.reflectorEnergySq.size(), 0);
+    }
+    if (bounceHits.size() < other.bounceHits.size()) {
+        bounceHits.resize(other.bounceHits.size(), 0);
+    }
+    rays += other.rays;
+    reflectorHits += other.reflectorHits;
+    reflectorShaded += other.reflectorShaded;
+    direct += other.direct;
+    backHits += other.backHits;
+    truncated += other.truncated;
+    absorbed += other.absorbed;
+    lost += other.lost;
+    for (size_t i = 0; i < other.receiverHits.size(); i++) {
+        receiverHits[i] += other.receiverHits[i];
+        receiverEnergy[i] += other.receiverEnergy[i];
+        receiverEnergySq[i] += other.receiverEnergySq[i];
+        reflectorEnergy[i] += other.reflectorEnergy[i];
+        reflectorEnergySq[i] += other.reflectorEnergySq[i];
+    }
+    for (size_t i = 0; i < other.bounceHits.size(); i++) {
+        bounceHits[i] += other.bounceHits[i];
     }
+}
 
-    collectorPoint = intersections[minIndex];
+// ** BounceScene Class **
+BounceScene::BounceScene() {
+    numOfPanels = 0;
+    reflectivity = 1;
+    maxBounces = 0;
+    top = -FLT_MAX;
+}
 
-    return collectored;
+BounceScene::BounceScene(const vector<Panel>& panels, const vector<Panel>& reflectors, const Collector& collector, const vector<Collector>& receivers, float reflectivity, int maxBounces) {
+    mirrors = panels;
+    mirrors.insert(mirrors.end(), reflectors.begin(), reflectors.end());
+    bvh.build(mirrors);
+    this->receivers.push_back(collector);
+    this->receivers.insert(this->receivers.end(), receivers.begin(), receivers.end());
+    numOfPanels = panels.size();
+    this->reflectivity = reflectivity;
+    this->maxBounces = maxBounces;
+    setTop();
 }
-void Ray::printGnuplot(ofstream& file) {
-    float distance = 1.5 * height;
-    if (!panelled) {
-        file << sunPoint.getX() << " " << sunPoint.getY() << " " << sunPoint.getZ() << " " << distance * vector.getX() << " " << distance * vector.getY() << " " << distance * vector.getZ() << endl;
+
+void BounceScene::setTop() {
+    top = -FLT_MAX;
+    for (size_t i = 0; i < mirrors.size(); i++) {
+        top = fmax(top, mirrors[i].getZ() + mirrors[i].getLength());
     }
-    else if (reflected) {
-        if (collectored) {
-            file << panelPoint.getX() << " " << panelPoint.getY() << " " << panelPoint.getZ() << " " << collectorPoint.getX() - panelPoint.getX() << " " << collectorPoint.getY() - panelPoint.getY() << " " << collectorPoint.getZ() - panelPoint.getZ() << endl;
-        }
-        else {
-            file << panelPoint.getX() << " " << panelPoint.getY() << " " << panelPoint.getZ() << " " << distance * vector.getX() << " " << distance * vector.getY() << " " << distance * vector.getZ() << endl;
-        }
+    for (size_t i = 0; i < receivers.size(); i++) {
+        top = fmax(top, receivers[i].getMaxZ().getd());
     }
-    else { // Hits Panel
-        file << sunPoint.getX() << " " << sunPoint.getY() << " " << sunPoint.getZ() << " " << panelPoint.getX() - sunPoint.getX() << " " << panelPoint.getY() - sunPoint.getY() << " " << panelPoint.getZ() - sunPoint.getZ() << endl;
+}
+
+void BounceScene::aim(const vector<Panel>& panels) {
+    for (int i = 0; i < numOfPanels; i++) {
+        mirrors[i] = panels[i];
     }
+    bvh.refit(mirrors);
+    setTop();
+}
+
+void BounceScene::clear() {
+    *this = BounceScene();
+}
+
+bool BounceScene::empty() const {
+    return mirrors.empty();
+}
+
+const vector<Panel>& BounceScene::getMirrors() const {
+    return mirrors;
+}
+const PanelBVH& BounceScene::getBVH() const {
+    return bvh;
+}
+const vector<Collector>& BounceScene::getReceivers() const {
+    return receivers;
+}
+int BounceScene::getNumOfPanels() const {
+    return numOfPanels;
+}
+float BounceScene::getReflectivity() const {
+    return reflectivity;
+}
+int BounceScene::getMaxBounces() const {
+    return maxBounces;
+}
+float BounceScene::getTop() const {
+    return top;
 }
 
 // ** Other Functions **
 
-void printRays(vector<Ray>& missPanel, vector<Ray>& hitPanel, vector<Ray>& missCollector, vector<Ray>& hitCollector) {
-    vector<Ray>::iterator rayIdx;
+void printRays(const vector<RayRecord>& missPanel, const vector<RayRecord>& hitPanel, const vector<RayRecord>& missCollector, const vector<RayRecord>& hitCollector) {
+    vector<RayRecord>::const_iterator rayIdx;
 
-    ofstream missPanelFile("Data/~miss_panel.txt");
+    AsyncOfstream missPanelFile("Data/~miss_panel.txt");
     int increment = 0;
     for (rayIdx = missPanel.begin(); rayIdx != missPanel.end(); rayIdx++) {
         if (increment++ % 1 == 0) {
@@ -163,39 +337,488 @@ void printRays(vector<Ray>& missPanel, vector<Ray>& hitPanel, vector<Ray>& missC
         }
     }
 
-    ofstream hitPanelFile("Data/~hit_panel.txt");
+    AsyncOfstream hitPanelFile("Data/~hit_panel.txt");
     for (rayIdx = hitPanel.begin(); rayIdx != hitPanel.end(); rayIdx++) {
         rayIdx->printGnuplot(hitPanelFile);
     }
 
-    ofstream missCollectorFile("Data/~miss_collector.txt");
+    AsyncOfstream missCollectorFile("Data/~miss_collector.txt");
     for (rayIdx = missCollector.begin(); rayIdx != missCollector.end(); rayIdx++) {
         rayIdx->printGnuplot(missCollectorFile);
     }
 
-    ofstream hitCollectorFile("Data/~hit_collector.txt");
+    AsyncOfstream hitCollectorFile("Data/~hit_collector.txt");
     for (rayIdx = hitCollector.begin(); rayIdx != hitCollector.end(); rayIdx++) {
         rayIdx->printGnuplot(hitCollectorFile);
     }
 }
 
-// Array of Panels
-vector<Ray> generateRays(int n, Point min, Point max, Sun sun, Collector collector, vector<Panel> panels, vector<Ray>& hitPanel, vector<Ray>& missPanel, vector<Ray>& hitCollector, vector<Ray>& missCollector, float collectorHeight) {
-    hitPanel.clear();
-    missPanel.clear();
-    hitCollector.clear();
-    missCollector.clear();
+// Rays and results of one tile of the sun-plane grid
+struct RayTile {
+    vector<RayRecord> allRays, hitPanel, missPanel, hitCollector, missCollector;
+    TraceCounts counts;
 
-    Vector sunVec = sun.getDirection() * -1;
-    height = (sun.getTime() - NOON) > 0 ? (21 - sun.getTime()) / 3 * collectorHeight : (sun.getTime() - 3) / 3 * collectorHeight;
+    void clear() { // Keeps the capacity for the next trace
+        allRays.clear();
+        hitPanel.clear();
+        missPanel.clear();
+        hitCollector.clear();
+        missCollector.clear();
+    }
+};
+
+// Height of the plane the sun rays start from
+static float getSunPlaneHeight(const Sun& sun, float collectorHeight) {
+    return (sun.getTime() - NOON) > 0 ? (21 - sun.getTime()) / 3 * collectorHeight : (sun.getTime() - 3) / 3 * collectorHeight;
+}
+
+// Sun-plane grid shared by all tiles of one trace
+struct RayGrid {
+    vector<float> xs, ys;
+    float xh, yh; // Spacing of the grid
+    float height;
+    Vector sunVec;
+    SamplingOptions sampling;
+    bool shading; // Nearest panel hits and blocking of the reflected rays
+};
+
+// Start point in the sun plane of ray k of the grid
+static inline void sampleCenter(const RayGrid& grid, long k, Point& center) {
+    long ny = grid.ys.size();
+    const SamplingOptions& sampling = grid.sampling;
+    if (sampling.mode == SAMPLE_JITTERED) {
+        center = Point(grid.xs[k / ny] + (sampleRandom(sampling.seed, k, 0) - 0.5f) * grid.xh, grid.ys[k % ny] + (sampleRandom(sampling.seed, k, 1) - 0.5f) * grid.yh, grid.height);
+    }
+    else if (sampling.mode == SAMPLE_HALTON) {
+        // The points are shifted by one random offset per trace so repeated seeds give independent estimates
+        float u = radicalInverse(k + 1, 2) + sampleRandom(sampling.seed, 0, 0);
+        float v = radicalInverse(k + 1, 3) + sampleRandom(sampling.seed, 0, 1);
+        u -= floor(u);
+        v -= floor(v);
+        center = Point(grid.xs[0] + (u * grid.xs.size() - 0.5f) * grid.xh, grid.ys[0] + (v * ny - 0.5f) * grid.yh, grid.height);
+    }
+    else {
+        center = Point(grid.xs[k / ny], grid.ys[k % ny], grid.height);
+    }
+}
+
+// Second point along the direction of ray k of the grid, from its start point
+static inline void samplePoint(const RayGrid& grid, long k, const Point& center, Point& point) {
+    const SamplingOptions& sampling = grid.sampling;
+    if (sampling.sunAngularRadius > 0) {
+        Vector sunVec = sampleCone(grid.sunVec, sampling.sunAngularRadius, sampleRandom(sampling.seed, k, 2), sampleRandom(sampling.seed, k, 3));
+        point = Point(center.getX() + sunVec.getX(), center.getY() + sunVec.getY(), center.getZ() + sunVec.getZ());
+    }
+    else {
+        point = Point(center.getX() + grid.sunVec.getX(), center.getY() + grid.sunVec.getY(), center.getZ() + grid.sunVec.getZ());
+    }
+}
+
+// Cells of the sun plane (at the spacing of the grid) through which a ray can reach a panel.
+// Each panel box is projected along the sun direction onto the plane; a ray starting in an
+// empty cell misses every panel and needs no intersection tests. On the regular grid the rays
+// outside of it are skipped a whole span at a time (nextCovered) instead of one by one.
+class SunFootprint {
+private:
+    double x0, y0, xh, yh;
+    double invXh, invYh;
+    int nx, ny;
+    vector<unsigned char> cells;
+    // For stepping through the regular grid: the cell of every grid row and column (as covers() finds
+    // them), the first marked cell at or after each cell of its row (ny if none), and the first grid
+    // column in each cell column or after it (the number of grid columns if none)
+    vector<int> rowCells, columnCells, nextCells, firstColumns;
+    bool stepping; // False when a grid point falls outside of the mask
+
+    void buildSteps(const RayGrid& grid) {
+        long gridRows = grid.xs.size(), gridColumns = grid.ys.size();
+        stepping = true;
+        rowCells.resize(gridRows);
+        for (long i = 0; i < gridRows; i++) {
+            double cell = (grid.xs[i] - x0) * invXh;
+            stepping = stepping && cell >= 0 && cell < nx;
+            rowCells[i] = stepping ? (int)cell : 0;
+        }
+        columnCells.resize(gridColumns);
+        for (long j = 0; j < gridColumns; j++) {
+            double cell = (grid.ys[j] - y0) * invYh;
+            stepping = stepping && cell >= 0 && cell < ny;
+            columnCells[j] = stepping ? (int)cell : 0;
+        }
+        if (!stepping) {
+            return;
+        }
+
+        nextCells.resize(cells.size());
+        for (int i = 0; i < nx; i++) {
+            int next = ny;
+            for (int j = ny - 1; j >= 0; j--) {
+                size_t c = (size_t)i * ny + j;
+                next = cells[c] ? j : next;
+                nextCells[c] = next;
+            }
+        }
+        // The cells of the columns never decrease along the grid
+        firstColumns.resize(ny + 1);
+        long column = 0;
+        for (int j = 0; j <= ny; j++) {
+            while (column < gridColumns && columnCells[column] < j) {
+                column++;
+            }
+            firstColumns[j] = column;
+        }
+    }
+public:
+    // Returns false when the footprint cannot be bounded (unbounded panel boxes, sun at the horizon)
+    bool build(const RayGrid& grid, const vector<Panel>& panels) {
+        const Vector& d = grid.sunVec;
+        if (grid.xs.empty() || grid.ys.empty() || fabs(d.getZ()) < 1e-3 * d.getMag()) {
+            return false;
+        }
+        xh = grid.xh;
+        yh = grid.yh;
+        invXh = 1 / xh;
+        invYh = 1 / yh;
+        x0 = grid.xs[0] - FOOTPRINT_MARGIN * xh;
+        y0 = grid.ys[0] - FOOTPRINT_MARGIN * yh;
+        nx = grid.xs.size() + 2 * FOOTPRINT_MARGIN;
+        ny = grid.ys.size() + 2 * FOOTPRINT_MARGIN;
+        cells.assign((size_t)nx * ny, 0);
 
-    vector<Ray> allRays;
-    vector<Ray> reflectedRays;
-    vector<Ray>::iterator rayIdx;
-    vector<Panel>::iterator panelIdx;
+        // Largest sideways drift per unit of height of a ray inside the sun-disk cone
+        double horizontal = sqrt(d.getX() * d.getX() + d.getY() * d.getY());
+        double zenith = atan2(horizontal, fabs(d.getZ())) + grid.sampling.sunAngularRadius;
+        if (zenith >= PI / 2 - 1e-3) {
+            return false;
+        }
+        double drift = grid.sampling.sunAngularRadius > 0 ? 2 * tan(grid.sampling.sunAngularRadius) / pow(cos(zenith), 2) : 0;
+
+        for (size_t p = 0; p < panels.size(); p++) {
+            BoundingBox box = getPanelBounds(panels[p]);
+            double minX = DBL_MAX, maxX = -DBL_MAX, minY = DBL_MAX, maxY = -DBL_MAX, largest = 1, height = 0;
+            for (int c = 0; c < 8; c++) {
+                double x = c & 1 ? box.getMax(0) : box.getMin(0);
+                double y = c & 2 ? box.getMax(1) : box.getMin(1);
+                double z = c & 4 ? box.getMax(2) : box.getMin(2);
+                if (fabs(x) >= FLT_MAX || fabs(y) >= FLT_MAX || fabs(z) >= FLT_MAX) {
+                    return false;
+                }
+                double t = (grid.height - z) / d.getZ(); // Along the sun direction up to the plane
+                double px = x + t * d.getX(), py = y + t * d.getY();
+                minX = min(minX, px); maxX = max(maxX, px);
+                minY = min(minY, py); maxY = max(maxY, py);
+                largest = max(largest, max(fabs(px), fabs(py)));
+                height = max(height, fabs(grid.height - z));
+            }
+            double pad = 1e-4 * largest + drift * height;
+            mark(minX - pad, maxX + pad, minY - pad, maxY + pad);
+        }
+        buildSteps(grid);
+        return true;
+    }
+
+    // Marks every cell touching the rectangle, plus one cell on each side against rounding
+    void mark(double minX, double maxX, double minY, double maxY) {
+        int i0 = max(0, (int)floor((minX - x0) / xh) - 1), i1 = min(nx - 1, (int)floor((maxX - x0) / xh) + 1);
+        int j0 = max(0, (int)floor((minY - y0) / yh) - 1), j1 = min(ny - 1, (int)floor((maxY - y0) / yh) + 1);
+        for (int i = i0; i <= i1; i++) {
+            for (int j = j0; j <= j1; j++) {
+                cells[(size_t)i * ny + j] = 1;
+            }
+        }
+    }
+
+    void reserve(int rows, int columns) {
+        size_t size = (size_t)(rows + 2 * FOOTPRINT_MARGIN) * (columns + 2 * FOOTPRINT_MARGIN);
+        cells.reserve(size);
+        nextCells.reserve(size);
+        rowCells.reserve(rows);
+        columnCells.reserve(columns);
+        firstColumns.reserve(columns + 2 * FOOTPRINT_MARGIN + 1);
+    }
+
+    bool covers(float x, float y) const {
+        // Rounding can only move a point into a neighbouring cell, and those are marked too
+        double i = (x - x0) * invXh, j = (y - y0) * invYh;
+        if (!(i >= 0 && j >= 0 && i < nx && j < ny)) {
+            return true; // Outside of the mask nothing is known
+        }
+        return cells[(size_t)i * ny + (size_t)j] != 0;
+    }
+
+    // First ray of the regular grid from k on (before kStop) that covers() keeps, or kStop. Each empty
+    // span of a row is crossed in one step.
+    long nextCovered(const RayGrid& grid, long k, long kStop) const {
+        if (!stepping) {
+            return k;
+        }
+        long gridColumns = grid.ys.size();
+        while (k < kStop) {
+            long i = k / gridColumns, j = k % gridColumns;
+            size_t rowStart = (size_t)rowCells[i] * ny;
+            int next = nextCells[rowStart + columnCells[j]];
+            if (next == columnCells[j]) {
+                return k;
+            }
+            k = i * gridColumns + firstColumns[next]; // The next row when the rest of this one is empty
+        }
+        return kStop;
+    }
+};
+
+// Whether another panel than skipPanel cuts the segment between two points
+static bool isOccluded(const Point& from, const Point& to, int skipPanel, const vector<Panel>& panels, const PanelBVH* bvh) {
+    if (bvh != NULL) {
+        return bvh->occluded(from, to, skipPanel, panels);
+    }
+    for (size_t p = 0; p < panels.size(); p++) {
+        if ((int)p != skipPanel && segmentHitsPanel(from, to, panels[p])) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Buffers of the wavefront pipeline of traceTile. Every stage reads the compacted index queue of the
+// stage before it and writes its own, always in grid order. They are kept from one trace to the next.
+struct Wavefront {
+    vector<Ray> rays; // Rays of the chunk; the culled ones are only generated when the rays are stored
+    vector<int> live; // generate -> panel hit: rays inside the footprint of the panels
+    vector<int> firstPanel; // Panel each ray hits, or -1
+    vector<Point> panelPoints;
+    vector<float> panelDistances; // Distance to the nearest panel of every ray, when shading without the BVH
+    vector<int> hitQueue; // panel hit -> reflect: rays hitting a panel
+    vector<Ray> reflectedRays; // reflect -> collector hit: one for each entry of hitQueue
+    vector<BoxCrossing> crossings; // Crossing of the collector of every reflected ray
+    vector<int> boxQueue; // Reflected rays crossing the collector
+    vector<unsigned char> collectorHits; // collector hit -> accumulate: one for each reflected ray
+    vector<unsigned char> hits;
+    RayBatch batch;
+
+    void reserve(size_t size) {
+        rays.reserve(size);
+        live.reserve(size);
+        firstPanel.reserve(size);
+        panelPoints.reserve(size);
+        hitQueue.reserve(size);
+        reflectedRays.reserve(size);
+        crossings.reserve(size);
+        boxQueue.reserve(size);
+        collectorHits.reserve(size);
+        hits.reserve(size);
+        batch.reserve(size);
+    }
+};
+
+// Stage 1: generates rays [kStart, kStop) of the grid and queues the ones inside the footprint. Rays
+// outside of it are misses; they are only built when they are stored, so the stored vectors keep the
+// order of the grid.
+static void generateStage(const RayGrid& grid, long kStart, long kStop, const SunFootprint* footprint, bool store, Wavefront& wave, TraceCounts& counts) {
+    wave.rays.clear();
+    wave.live.clear();
+    wave.batch.clear();
+    bool stepping = footprint != NULL && !store && grid.sampling.mode == SAMPLE_GRID;
+    for (long k = kStart; k < kStop; k++) {
+        if (stepping) { // The rays outside of the footprint are not even placed
+            long next = footprint->nextCovered(grid, k, kStop);
+            counts.missPanel += next - k;
+            k = next;
+            if (k == kStop) {
+                break;
+            }
+        }
+        Point center, point;
+        sampleCenter(grid, k, center);
+        bool culled = !stepping && footprint != NULL && !footprint->covers(center.getX(), center.getY());
+        if (culled && !store) {
+            counts.missPanel++;
+            continue;
+        }
+        samplePoint(grid, k, center, point);
+        wave.rays.emplace_back(center, point);
+        if (!culled) {
+            wave.live.push_back(wave.rays.size() - 1);
+            wave.batch.push(wave.rays.back().getLine().getPointVector(), wave.rays.back().getLine().getDirectionVector());
+        }
+    }
+}
+
+// Stage 2: finds the panel of every live ray, either through the BVH or by testing the whole batch
+// against each panel, and queues the rays that hit one. With shading the panel is the nearest one
+// along the ray instead of the first in order.
+static void panelStage(const RayGrid& grid, const vector<Panel>& panels, const PanelBVH* bvh, Wavefront& wave, TraceCounts& counts) {
+    vector<Ray>& rays = wave.rays;
+    vector<int>& firstPanel = wave.firstPanel;
+    const vector<int>& live = wave.live;
+    firstPanel.assign(rays.size(), -1);
+    if (bvh != NULL) {
+        wave.panelPoints.resize(rays.size());
+        for (size_t j = 0; j < live.size(); j++) {
+            if (grid.shading) {
+                int numHits;
+                firstPanel[live[j]] = bvh->closestHit(rays[live[j]], panels, wave.panelPoints[live[j]], numHits);
+                if (numHits > 1) {
+                    counts.shaded += numHits - 1;
+                }
+            }
+            else {
+                firstPanel[live[j]] = bvh->firstHit(rays[live[j]], panels, wave.panelPoints[live[j]]);
+            }
+        }
+    }
+    else {
+        vector<unsigned char>& hits = wave.hits;
+        hits.resize(wave.batch.size());
+        if (grid.shading) {
+            wave.panelDistances.assign(rays.size(), FLT_MAX);
+        }
+        for (size_t p = 0; p < panels.size(); p++) {
+            intersectPanel(wave.batch, panels[p], hits.data());
+            for (size_t j = 0; j < hits.size(); j++) {
+                if (!hits[j]) {
+                    continue;
+                }
+                int i = live[j];
+                if (grid.shading) {
+                    Point intersection;
+                    if (rays[i].intersectsPanel(panels[p], intersection)) {
+                        if (firstPanel[i] >= 0) {
+                            counts.shaded++;
+                        }
+                        float distance = getDistanceAlongRay(rays[i], intersection);
+                        if (distance < wave.panelDistances[i]) {
+                            wave.panelDistances[i] = distance;
+                            firstPanel[i] = p;
+                        }
+                    }
+                }
+                else if (firstPanel[i] < 0) {
+                    firstPanel[i] = p;
+                }
+            }
+        }
+    }
+
+    // Each intersection is computed once: by the BVH, or here for the panel the batch search found
+    wave.hitQueue.clear();
+    for (size_t i = 0; i < rays.size(); i++) {
+        if (firstPanel[i] < 0) {
+            counts.missPanel++;
+            continue;
+        }
+        if (bvh != NULL) {
+            rays[i].setPanelPoint(wave.panelPoints[i]);
+        }
+        else {
+            rays[i].hitsPanel(panels[firstPanel[i]]);
+        }
+        counts.hitPanel++;
+        counts.panelHits[firstPanel[i]]++;
+        wave.hitQueue.push_back(i);
+    }
+}
+
+// Stage 3: reflects the rays of hitQueue off their panels
+static void reflectStage(const vector<Panel>& panels, Wavefront& wave) {
+    wave.reflectedRays.resize(wave.hitQueue.size());
+    for (size_t j = 0; j < wave.hitQueue.size(); j++) {
+        int i = wave.hitQueue[j];
+        wave.rays[i].reflectAt(panels[wave.firstPanel[i]], wave.reflectedRays[j]);
+    }
+}
+
+// Stage 4: the slab kernel finds where every reflected ray crosses the collector, and only the rays
+// that cross it are queued to record their hit. With shading a hit still has to pass the panels
+// between its panel and the collector.
+static void collectorStage(const RayGrid& grid, const Collector& collector, const vector<Panel>& panels, const PanelBVH* bvh, Wavefront& wave, TraceCounts& counts) {
+    vector<Ray>& reflectedRays = wave.reflectedRays;
+    wave.batch.clear();
+    for (size_t j = 0; j < reflectedRays.size(); j++) {
+        wave.batch.push(reflectedRays[j].getLine().getPointVector(), reflectedRays[j].getLine().getDirectionVector());
+    }
+    wave.crossings.resize(wave.batch.size());
+    intersectCollector(wave.batch, collector, wave.crossings.data());
+    wave.boxQueue.clear();
+    for (size_t j = 0; j < wave.crossings.size(); j++) {
+        if (wave.crossings[j].enterFace >= 0) {
+            wave.boxQueue.push_back(j);
+        }
+    }
+
+    wave.collectorHits.assign(reflectedRays.size(), 0);
+    for (size_t q = 0; q < wave.boxQueue.size(); q++) {
+        int j = wave.boxQueue[q];
+        reflectedRays[j].hitsCollector(wave.crossings[j]);
+        if (grid.shading && isOccluded(reflectedRays[j].getPanelPoint(), reflectedRays[j].getCollectorPoint(), wave.firstPanel[wave.hitQueue[j]], panels, bvh)) {
+            counts.blocked++;
+            continue;
+        }
+        wave.collectorHits[j] = 1;
+    }
+}
+
+// Stage 5: counts the collector results and moves the rays to the tile when they are stored
+static void accumulateStage(bool store, Wavefront& wave, RayTile& tile) {
+    TraceCounts& counts = tile.counts;
+    for (size_t j = 0; j < wave.reflectedRays.size(); j++) {
+        if (wave.collectorHits[j]) {
+            counts.hitCollector++;
+            counts.panelCollectorHits[wave.firstPanel[wave.hitQueue[j]]]++;
+        }
+        else {
+            counts.missCollector++;
+        }
+    }
+    if (!store) {
+        return;
+    }
+    for (size_t i = 0; i < wave.rays.size(); i++) {
+        RayRecord record(wave.rays[i], wave.firstPanel[i]);
+        (wave.firstPanel[i] >= 0 ? tile.hitPanel : tile.missPanel).push_back(record);
+        tile.allRays.push_back(record);
+    }
+    for (size_t j = 0; j < wave.reflectedRays.size(); j++) {
+        (wave.collectorHits[j] ? tile.hitCollector : tile.missCollector).push_back(RayRecord(wave.reflectedRays[j], wave.firstPanel[wave.hitQueue[j]]));
+    }
+}
+
+// Traces the grid rows [rowStart, rowEnd) through the wavefront stages, TRACE_CHUNK rays at a time.
+// Results are always counted into tile.counts; the rays themselves are only kept in the tile when
+// store is set.
+static void traceTile(const RayGrid& grid, int rowStart, int rowEnd, const Collector& collector, const vector<Panel>& panels, const PanelBVH* bvh, const SunFootprint* footprint, bool store, RayTile& tile) {
+    // The buffers of each thread are kept from one trace to the next
+    static thread_local Wavefront wave;
+    wave.reserve(TRACE_CHUNK);
+    tile.counts.reset(panels.size());
+    tile.clear();
+    if (store) {
+        tile.allRays.reserve((size_t)(rowEnd - rowStart) * grid.ys.size());
+    }
+
+    long ny = grid.ys.size();
+    long kEnd = rowEnd * ny;
+    for (long kStart = rowStart * ny; kStart < kEnd; kStart += TRACE_CHUNK) {
+        long kStop = kStart + TRACE_CHUNK < kEnd ? kStart + TRACE_CHUNK : kEnd;
+        generateStage(grid, kStart, kStop, footprint, store, wave, tile.counts);
+        panelStage(grid, panels, bvh, wave, tile.counts);
+        reflectStage(panels, wave);
+        collectorStage(grid, collector, panels, bvh, wave, tile.counts);
+        accumulateStage(store, wave, tile);
+    }
+}
+
+// Sets up the sun-plane grid at the given height over the field between min and max
+static void buildGrid(int n, const Point& min, const Point& max, const Sun& sun, const vector<Panel>& panels, float height, const SamplingOptions& sampling, RayGrid& grid) {
+    grid.sampling = sampling;
+    grid.shading = false;
+    grid.sunVec = sun.getDirection() * -1;
+    Vector sunVec = grid.sunVec;
+    grid.height = height;
 
     float xh = abs(max.getX() - min.getX()) / n;
     float yh = abs(max.getY() - min.getY()) / n;
+    grid.xh = xh;
+    grid.yh = yh;
 
     //
     // Determining the bounds:
@@ -207,45 +830,482 @@ vector<Ray> generateRays(int n, Point min, Point max, Sun sun, Collector collect
     //
     //
 
-    // Generating all Rays
+    // Grid coordinates, accumulated exactly like the serial loops so every thread count sees the same rays
     for (float i = minIntersection.getX() - 4 * panels[0].getLength(); i <= maxIntersection.getX() + 4 * panels[0].getLength(); i += xh) {
-        for (float j = minIntersection.getY() - 4 * panels[0].getLength(); j <= maxIntersection.getY() + 4 * panels[0].getLength(); j += yh) {
-            Point center(i, j, height);
-            Point point(center.getX() + sunVec.getX(), center.getY() + sunVec.getY(), center.getZ() + sunVec.getZ());
-            Ray oneRay(center, point);
-            allRays.push_back(oneRay);
-        }
+        grid.xs.push_back(i);
     }
+    for (float j = minIntersection.getY() - 4 * panels[0].getLength(); j <= maxIntersection.getY() + 4 * panels[0].getLength(); j += yh) {
+        grid.ys.push_back(j);
+    }
+}
 
-    // Storing hitPanel and missPanel
-    for (rayIdx = allRays.begin(); rayIdx != allRays.end(); rayIdx++) {
-        bool hitsAnyPanel = false;
-        for (panelIdx = panels.begin(); panelIdx != panels.end(); panelIdx++) {
-            if (!rayIdx->getPanelled() && rayIdx->hitsPanel(*panelIdx)) {
-                hitPanel.push_back(*rayIdx);
-                hitsAnyPanel = true;
-                Ray reflectedRay;
-                rayIdx->reflect(*panelIdx, reflectedRay);
-                reflectedRays.push_back(reflectedRay);
-            }
-        }
-        if (!hitsAnyPanel) {
-            missPanel.push_back(*rayIdx);
+// Number of grid tiles handed to the thread pool, and the grid rows of each
+static int getNumOfTiles(const RayGrid& grid, int& numThreads, int& rowsPerTile) {
+    if (numThreads <= 0) {
+        numThreads = ThreadPool::getHardwareThreads();
+    }
+    rowsPerTile = grid.xs.size() / (TILES_PER_THREAD * numThreads);
+    if (rowsPerTile < 1) {
+        rowsPerTile = 1;
+    }
+    int numRows = grid.xs.size();
+    return (numRows + rowsPerTile - 1) / rowsPerTile;
+}
+
+// ** RayArena Class **
+struct RayArena::Storage {
+    RayGrid grid;
+    SunFootprint footprint;
+    vector<RayTile> tiles;
+    vector<RayRecord> allRays; // Returned by generateRays
+};
+
+RayArena::RayArena() {
+    storage = new Storage();
+}
+RayArena::RayArena(const RayArena& other) {
+    storage = new Storage();
+}
+RayArena& RayArena::operator=(const RayArena& other) {
+    if (this != &other) {
+        release();
+    }
+    return *this;
+}
+RayArena::~RayArena() {
+    delete storage;
+}
+RayArena::Storage& RayArena::get() {
+    return *storage;
+}
+void RayArena::reserve(int rows, int columns, bool store) {
+    storage->grid.xs.reserve(rows);
+    storage->grid.ys.reserve(columns);
+    storage->footprint.reserve(rows, columns);
+    if (store) {
+        storage->allRays.reserve((size_t)rows * columns);
+    }
+}
+void RayArena::release() {
+    delete storage;
+    storage = new Storage();
+}
+
+// Arena of the calling thread, for the traces that are not given one
+static RayArena& getThreadArena() {
+    static thread_local RayArena arena;
+    return arena;
+}
+
+// Everything one tile job needs, so the task handed to the thread pool only holds a pointer
+struct GridJob {
+    const RayGrid* grid;
+    const Collector* collector;
+    const vector<Panel>* panels;
+    const PanelBVH* bvh;
+    const SunFootprint* footprint;
+    bool store;
+    int rowsPerTile, numRows;
+    vector<RayTile>* tiles;
+
+    void run(int t) const {
+        int rowEnd = (t + 1) * rowsPerTile < numRows ? (t + 1) * rowsPerTile : numRows;
+        traceTile(*grid, t * rowsPerTile, rowEnd, *collector, *panels, bvh, footprint, store, (*tiles)[t]);
+    }
+};
+
+// Builds the grid and traces it in tiles on the thread pool. The tiles are left in the arena in grid
+// order; all buffers keep their capacity, so tracing the same field again does not allocate.
+static void traceGrid(int n, const Point& min, const Point& max, const Sun& sun, const Collector& collector, const vector<Panel>& panels, float collectorHeight, const PanelBVH* bvh, int numThreads, const SamplingOptions& sampling, bool shading, bool store, RayArena::Storage& arena) {
+    RayGrid& grid = arena.grid;
+    grid.xs.clear();
+    grid.ys.clear();
+    float height = getSunPlaneHeight(sun, collectorHeight);
+    if (store) {
+        ::height = height;
+    }
+    buildGrid(n, min, max, sun, panels, height, sampling, grid);
+    grid.shading = shading;
+
+    // Tracing the tiles; each tile only writes into its own buffers
+    GridJob job;
+    int numTiles = getNumOfTiles(grid, numThreads, job.rowsPerTile);
+    job.numRows = grid.xs.size();
+    arena.tiles.resize(numTiles);
+    job.grid = &grid;
+    job.collector = &collector;
+    job.panels = &panels;
+    job.bvh = bvh;
+    job.footprint = FOOTPRINT_CULLING && arena.footprint.build(grid, panels) ? &arena.footprint : NULL;
+    job.store = store;
+    job.tiles = &arena.tiles;
+    const GridJob& tileJob = job;
+    ThreadPool::shared().parallelFor(numTiles, [&tileJob](int t) {
+        tileJob.run(t);
+    }, numThreads);
+}
+
+// Copies the rays of a tile to the end of an output vector; the tile keeps its capacity
+static void appendRays(vector<RayRecord>& to, vector<RayRecord>& from) {
+    to.insert(to.end(), from.begin(), from.end());
+    from.clear();
+}
+
+// Array of Panels
+const vector<RayRecord>& generateRays(int n, const Point& min, const Point& max, const Sun& sun, const Collector& collector, const vector<Panel>& panels, vector<RayRecord>& hitPanel, vector<RayRecord>& missPanel, vector<RayRecord>& hitCollector, vector<RayRecord>& missCollector, float collectorHeight, const PanelBVH* bvh, int numThreads, TraceCounts* counts, const SamplingOptions& sampling, bool shading, RayArena* rayArena) {
+    hitPanel.clear();
+    missPanel.clear();
+    hitCollector.clear();
+    missCollector.clear();
+
+    RayArena::Storage& arena = (rayArena != NULL ? *rayArena : getThreadArena()).get();
+    vector<RayRecord>& allRays = arena.allRays;
+    allRays.clear();
+    traceGrid(n, min, max, sun, collector, panels, collectorHeight, bvh, numThreads, sampling, shading, true, arena);
+    vector<RayTile>& tiles = arena.tiles;
+
+    // Merging the tiles in grid order, which is the order of the serial loops
+    if (counts != NULL) {
+        counts->reset(panels.size());
+    }
+    size_t sizes[5] = { 0, 0, 0, 0, 0 };
+    for (vector<RayTile>::iterator tileIdx = tiles.begin(); tileIdx != tiles.end(); tileIdx++) {
+        sizes[0] += tileIdx->allRays.size();
+        sizes[1] += tileIdx->hitPanel.size();
+        sizes[2] += tileIdx->missPanel.size();
+        sizes[3] += tileIdx->hitCollector.size();
+        sizes[4] += tileIdx->missCollector.size();
+    }
+    allRays.reserve(sizes[0]);
+    hitPanel.reserve(sizes[1]);
+    missPanel.reserve(sizes[2]);
+    hitCollector.reserve(sizes[3]);
+    missCollector.reserve(sizes[4]);
+    for (vector<RayTile>::iterator tileIdx = tiles.begin(); tileIdx != tiles.end(); tileIdx++) {
+        appendRays(allRays, tileIdx->allRays);
+        appendRays(hitPanel, tileIdx->hitPanel);
+        appendRays(missPanel, tileIdx->missPanel);
+        appendRays(hitCollector, tileIdx->hitCollector);
+        appendRays(missCollector, tileIdx->missCollector);
+        if (counts != NULL) {
+            counts->add(tileIdx->counts);
         }
     }
 
-    // Storing hitCollector and missCollector
-    for (rayIdx = reflectedRays.begin(); rayIdx != reflectedRays.end(); rayIdx++) {
-        if (rayIdx->hitsCollector(collector)) {
-            hitCollector.push_back(*rayIdx);
+    return allRays;
+}
+
+void countRays(int n, const Point& min, const Point& max, const Sun& sun, const Collector& collector, const vector<Panel>& panels, TraceCounts& counts, float collectorHeight, const PanelBVH* bvh, int numThreads, const SamplingOptions& sampling, bool shading, RayArena* rayArena) {
+    RayArena::Storage& arena = (rayArena != NULL ? *rayArena : getThreadArena()).get();
+    traceGrid(n, min, max, sun, collector, panels, collectorHeight, bvh, numThreads, sampling, shading, false, arena);
+
+    counts.reset(panels.size());
+    for (vector<RayTile>::iterator tileIdx = arena.tiles.begin(); tileIdx != arena.tiles.end(); tileIdx++) {
+        counts.add(tileIdx->counts);
+    }
+}
+
+// Rays and results of the beam of one panel
+struct PanelBeam {
+    vector<RayRecord> hitPanel, hitCollector, missCollector;
+    long hits, collectorHits, shaded, blocked;
+};
+
+// Traces the n * n rays of the beam of panel p
+static void tracePanelBeam(int n, int p, const Vector& sunVec, float height, const Collector& collector, const vector<Panel>& panels, const PanelBVH* bvh, bool shading, const SamplingOptions& sampling, bool store, PanelBeam& beam) {
+    beam.hits = beam.collectorHits = beam.shaded = beam.blocked = 0;
+    const Panel& panel = panels[p];
+    const Plane& plane = panel.getPlane();
+    if (fabs(plane.getc()) < 1e-6 || !(panel.getNormal().dot(sunVec) < 0)) {
+        return; // Vertical or facing away from the sun: the panel reflects nothing into the collector
+    }
+
+    float minX = panel.getMinX(), minY = panel.getMinY();
+    float sizeX = panel.getMaxX() - minX, sizeY = panel.getMaxY() - minY;
+    uint64_t first = (uint64_t)p * n * n; // Ray indices of the panel, so every panel draws its own random numbers
+    for (int k = 0; k < n * n; k++) {
+        float u, v;
+        if (sampling.mode == SAMPLE_JITTERED) {
+            u = (k / n + sampleRandom(sampling.seed, first + k, 0)) / n;
+            v = (k % n + sampleRandom(sampling.seed, first + k, 1)) / n;
+        }
+        else if (sampling.mode == SAMPLE_HALTON) {
+            u = radicalInverse(k + 1, 2) + sampleRandom(sampling.seed, first, 0);
+            v = radicalInverse(k + 1, 3) + sampleRandom(sampling.seed, first, 1);
+            u -= floor(u);
+            v -= floor(v);
         }
         else {
-            missCollector.push_back(*rayIdx);
+            u = (k / n + 0.5f) / n;
+            v = (k % n + 0.5f) / n;
+        }
+        float x = minX + u * sizeX, y = minY + v * sizeY;
+        Point panelPoint(x, y, plane.getZ(x, y));
+
+        Vector rayVec = sunVec;
+        if (sampling.sunAngularRadius > 0) {
+            rayVec = sampleCone(sunVec, sampling.sunAngularRadius, sampleRandom(sampling.seed, first + k, 2), sampleRandom(sampling.seed, first + k, 3));
+        }
+        // The incoming ray starts in the sun plane above the panel point
+        float t = (height - panelPoint.getZ()) / -rayVec.getZ();
+        Point center(panelPoint.getX() - t * rayVec.getX(), panelPoint.getY() - t * rayVec.getY(), height);
+        Ray ray(center, Point(center.getX() + rayVec.getX(), center.getY() + rayVec.getY(), center.getZ() + rayVec.getZ()));
+        ray.setPanelPoint(panelPoint);
+        beam.hits++;
+        if (store) {
+            beam.hitPanel.push_back(RayRecord(ray, p));
+        }
+
+        Ray reflectedRay;
+        ray.reflectAt(panel, reflectedRay);
+        bool hit = reflectedRay.hitsCollector(collector);
+        // A shaded ray never reaches the panel; a blocked one is stopped on its way to the collector
+        if (shading && isOccluded(center, panelPoint, p, panels, bvh)) {
+            hit = false;
+            beam.shaded++;
+        }
+        else if (hit && shading && isOccluded(panelPoint, reflectedRay.getCollectorPoint(), p, panels, bvh)) {
+            hit = false;
+            beam.blocked++;
+        }
+        if (hit) {
+            beam.collectorHits++;
+        }
+        if (store) {
+            (hit ? beam.hitCollector : beam.missCollector).push_back(RayRecord(reflectedRay, p));
         }
     }
+}
 
-    return allRays;
+void traceBeams(int n, const Sun& sun, const Collector& collector, const vector<Panel>& panels, TraceCounts& counts, float collectorHeight, int numThreads, const SamplingOptions& sampling, vector<RayRecord>* hitPanel, vector<RayRecord>* hitCollector, vector<RayRecord>* missCollector, const PanelBVH* bvh, bool shading) {
+    bool store = hitPanel != NULL && hitCollector != NULL && missCollector != NULL;
+    Vector sunVec = sun.getDirection() * -1;
+    float height = getSunPlaneHeight(sun, collectorHeight);
+    if (store) {
+        ::height = height;
+    }
+
+    vector<PanelBeam> beams(panels.size());
+    ThreadPool::shared().parallelFor(panels.size(), [&](int p) {
+        tracePanelBeam(n, p, sunVec, height, collector, panels, bvh, shading, sampling, store, beams[p]);
+    }, numThreads);
+
+    counts.reset(panels.size());
+    if (store) {
+        hitPanel->clear();
+        hitCollector->clear();
+        missCollector->clear();
+    }
+    for (size_t p = 0; p < beams.size(); p++) {
+        counts.hitPanel += beams[p].hits;
+        counts.hitCollector += beams[p].collectorHits;
+        counts.missCollector += beams[p].hits - beams[p].collectorHits;
+        counts.shaded += beams[p].shaded;
+        counts.blocked += beams[p].blocked;
+        counts.panelHits[p] = beams[p].hits;
+        counts.panelCollectorHits[p] = beams[p].collectorHits;
+        if (store) {
+            appendRays(*hitPanel, beams[p].hitPanel);
+            appendRays(*hitCollector, beams[p].hitCollector);
+            appendRays(*missCollector, beams[p].missCollector);
+        }
+    }
 }
 
 
+// Distance (in lengths of direction) at which the half line from origin enters the receiver box
+static bool getReceiverDistance(const Collector& receiver, const Point& origin, const Vector& direction, float& distance) {
+    BoxCrossing crossing;
+    if (!intersectCollector(Vector(origin.getX(), origin.getY(), origin.getZ()), direction, receiver, crossing) || crossing.tExit < 0) {
+        return false;
+    }
+    distance = crossing.tEnter > 0 ? crossing.tEnter : 0; // 0 when the origin is inside the box
+    return true;
+}
+
+// Follows the paths of the grid rows [rowStart, rowEnd) through the scene
+static void traceBounceTile(const RayGrid& grid, int rowStart, int rowEnd, const BounceScene& scene, const SunFootprint* footprint, TraceCounts& counts) {
+    const vector<Panel>& mirrors = scene.getMirrors();
+    const vector<Collector>& receivers = scene.getReceivers();
+    const PanelBVH& bvh = scene.getBVH();
+    int numOfPanels = scene.getNumOfPanels();
+    float reflectivity = scene.getReflectivity();
+    int maxBounces = scene.getMaxBounces();
+    BounceCounts& bounces = counts.bounces;
+    counts.reset(mirrors.size());
+    bounces.reset(receivers.size(), maxBounces);
+
+    long ny = grid.ys.size();
+    long kEnd = rowEnd * ny;
+    bool stepping = footprint != NULL && grid.sampling.mode == SAMPLE_GRID;
+    for (long k = rowStart * ny; k < kEnd; k++) {
+        if (stepping) { // The rays outside of the footprint cannot reach a mirror
+            long next = footprint->nextCovered(grid, k, kEnd);
+            bounces.rays += next - k;
+            counts.missPanel += next - k;
+            k = next;
+            if (k == kEnd) {
+                break;
+            }
+        }
+        Point center, point;
+        sampleCenter(grid, k, center);
+        bounces.rays++;
+        if (!stepping && footprint != NULL && !footprint->covers(center.getX(), center.getY())) {
+            counts.missPanel++; // Cannot reach a mirror
+            continue;
+        }
+        samplePoint(grid, k, center, point);
+        Ray ray(center, point);
+        Point origin = center;
+        int from = -1, firstMirror = -1;
+        float energy = 1;
+        bool collected = false; // The path ends in receiver 0
+        for (int depth = 0; ; depth++) {
+            const Vector& direction = ray.getVector();
+            float mirrorDistance;
+            int numHits = 0;
+            int mirror = bvh.nearestHit(origin, direction, from, mirrors, mirrorDistance, depth == 0 ? &numHits : NULL);
+            int receiver = -1;
+            float receiverDistance = mirrorDistance;
+            for (size_t r = 0; r < receivers.size(); r++) {
+                float t;
+                if (getReceiverDistance(receivers[r], origin, direction, t) && t < receiverDistance) {
+                    receiver = r;
+                    receiverDistance = t;
+                }
+            }
+
+            if (receiver >= 0) {
+                if (depth == 0) {
+                    bounces.direct++; // Counted with the direct power instead
+                    counts.missPanel++;
+                    break;
+                }
+                bounces.receiverHits[receiver]++;
+                bounces.receiverEnergy[receiver] += energy;
+                bounces.receiverEnergySq[receiver] += energy * energy;
+                bounces.bounceHits[depth]++;
+                if (firstMirror >= numOfPanels) {
+                    bounces.reflectorEnergy[receiver] += energy;
+                    bounces.reflectorEnergySq[receiver] += energy * energy;
+                }
+                collected = receiver == 0;
+                break;
+            }
+            if (mirror < 0) {
+                if (depth == 0) {
+                    counts.missPanel++;
+                }
+                else {
+                    bounces.lost += energy;
+                }
+                break;
+            }
+            if (depth == 0) {
+                // The mirrors behind the first one are shaded, as in the shaded grid. The few reflectors
+                // are tested apart so the panel and the reflector hits can be told from each other.
+                int reflectorHits = 0;
+                for (size_t m = numOfPanels; m < mirrors.size(); m++) {
+                    float t;
+                    reflectorHits += rayHitsPanel(origin, direction, mirrors[m], t);
+                }
+                firstMirror = mirror;
+                counts.panelHits[mirror]++;
+                if (mirror < numOfPanels) {
+                    counts.hitPanel++;
+                    counts.shaded += numHits - reflectorHits - 1;
+                    bounces.reflectorShaded += reflectorHits;
+                }
+                else {
+                    counts.missPanel++; // Not a panel hit; the reflectors have their own power
+                    counts.shaded += numHits - reflectorHits;
+                    bounces.reflectorHits++;
+                    bounces.reflectorShaded += reflectorHits - 1;
+                }
+            }
+
+            const Panel& panel = mirrors[mirror];
+            if (!(panel.getNormal().dot(direction) < 0)) {
+                bounces.backHits++;
+                bounces.absorbed += energy;
+                break;
+            }
+            if (depth == maxBounces) {
+                bounces.truncated++;
+                bounces.lost += energy;
+                break;
+            }
+
+            // Reflecting off the mirror and carrying on from the hit point
+            origin = Point(origin.getX() + mirrorDistance * direction.getX(), origin.getY() + mirrorDistance * direction.getY(), origin.getZ() + mirrorDistance * direction.getZ());
+            ray.setPanelPoint(origin);
+            Ray reflectedRay;
+            ray.reflectAt(panel, reflectedRay);
+            ray = reflectedRay;
+            if (depth > 0) { // The panel and reflector powers already account for the first reflection
+                bounces.absorbed += energy * (1 - reflectivity);
+                energy *= reflectivity;
+            }
+            from = mirror;
+        }
+
+        // The single-bounce view only covers the paths starting on a panel
+        if (firstMirror >= 0 && firstMirror < numOfPanels) {
+            if (collected) {
+                counts.hitCollector++;
+                counts.panelCollectorHits[firstMirror]++;
+            }
+            else {
+                counts.missCollector++;
+            }
+        }
+    }
+}
+
+// Everything one tile job of traceBounces needs, so the task handed to the thread pool only holds a pointer
+struct BounceJob {
+    const RayGrid* grid;
+    const BounceScene* scene;
+    const SunFootprint* footprint;
+    int rowsPerTile, numRows;
+    vector<RayTile>* tiles;
+
+    void run(int t) const {
+        int rowEnd = (t + 1) * rowsPerTile < numRows ? (t + 1) * rowsPerTile : numRows;
+        traceBounceTile(*grid, t * rowsPerTile, rowEnd, *scene, footprint, (*tiles)[t].counts);
+    }
+};
+
+void traceBounces(int n, const Point& min, const Point& max, const Sun& sun, const BounceScene& scene, TraceCounts& counts, float collectorHeight, int numThreads, const SamplingOptions& sampling, RayArena* rayArena) {
+    RayArena::Storage& arena = (rayArena != NULL ? *rayArena : getThreadArena()).get();
+    // The rays start above everything they could hit
+    float height = fmax(getSunPlaneHeight(sun, collectorHeight), scene.getTop() + BOUNCE_CLEARANCE);
+    RayGrid& grid = arena.grid;
+    grid.xs.clear();
+    grid.ys.clear();
+    buildGrid(n, min, max, sun, scene.getMirrors(), height, sampling, grid);
+
+    BounceJob job;
+    int numTiles = getNumOfTiles(grid, numThreads, job.rowsPerTile);
+    job.numRows = grid.xs.size();
+    vector<RayTile>& tiles = arena.tiles;
+    tiles.resize(numTiles);
+    job.grid = &grid;
+    job.scene = &scene;
+    job.footprint = FOOTPRINT_CULLING && arena.footprint.build(grid, scene.getMirrors()) ? &arena.footprint : NULL;
+    job.tiles = &tiles;
+    const BounceJob& tileJob = job;
+    ThreadPool::shared().parallelFor(numTiles, [&tileJob](int t) {
+        tileJob.run(t);
+    }, numThreads);
+
+    // Merging in grid order so the sums do not depend on the number of threads
+    counts.reset(scene.getMirrors().size());
+    counts.bounces.reset(scene.getReceivers().size(), scene.getMaxBounces());
+    for (int t = 0; t < numTiles; t++) {
+        counts.add(tiles[t].counts);
+    }
+}
+
 #endif
\ No newline at end of file
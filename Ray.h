@@ -3,8 +3,21 @@
 
 #include <iostream>
 #include <limits.h>
+#include <float.h>
+#include <stdint.h>
 #include <vector>
 #include "Components.h" // Also gets Position.h
+#include "BVH.h"
+#include "ThreadPool.h"
+#include "RayBatch.h"
+#include "AsyncWriter.h"
+#include "Sampling.h"
+
+#define TILES_PER_THREAD 4 // Tiles of the sun-plane grid handed to each thread by generateRays
+#define TRACE_CHUNK 1024 // Rays generated and traced together inside a tile
+#define FOOTPRINT_CULLING 1 // Rays outside of the panels projected onto the sun plane are counted as misses without tests
+#define FOOTPRINT_MARGIN 2 // Cells of the footprint mask beyond each side of the grid
+#define BOUNCE_CLEARANCE 0.01 // Height the rays of traceBounces start above the highest mirror or receiver
 
 using namespace std;
 
@@ -23,27 +36,175 @@ private:
     Point collectorPoint;
 public:
     Ray();
-    Ray(Point center, Point point);
-    Ray(Vector ivector, Line iline);
+    Ray(const Point& center, const Point& point);
+    Ray(const Vector& ivector, const Line& iline);
     Line& getLine();
+    const Line& getLine() const;
     Vector& getVector();
+    const Vector& getVector() const;
 
     bool getReflected() const;
     bool getCollectored() const;
     bool getPanelled() const;
 
-    Point getPanelPoint() const;
-    Point getCollectorPoint() const;
+    const Point& getSunPoint() const;
+    const Point& getPanelPoint() const;
+    const Point& getCollectorPoint() const;
+
+    // Tests the ray against the panel without changing the ray
+    bool intersectsPanel(const Panel& panel, Point& intersection) const;
+    bool hitsPanel(const Panel& panel);
+    void setPanelPoint(const Point& intersection); // Records a hit found by intersectsPanel
+    bool reflect(const Panel& panel, Ray& reflectedRay);
+    void reflectAt(const Panel& panel, Ray& reflectedRay) const; // Reflects at the recorded panel point
+    bool hitsCollector(const Collector& collector);
+    bool hitsCollector(const BoxCrossing& crossing); // Records a crossing found by intersectCollector
+    void getSegment(float* segment) const; // Start point and vector (6 floats) of the drawn ray
+    void printGnuplot(ostream& file) const;
+};
+
+#define RAY_PANELLED 1
+#define RAY_REFLECTED 2
+#define RAY_COLLECTORED 4
+#define RAY_STATE_BITS 3
+
+// Compact record of a stored ray: 28 bytes instead of the 76 of a Ray. It keeps the start of the
+// drawn segment, either the vector of the ray or (when the segment ends on a panel or on the
+// collector) the exact segment, and the state bits with the index of the panel hit above them.
+// The segment of Ray::getSegment is rebuilt from it on demand.
+class RayRecord {
+private:
+    float origin[3];
+    float direction[3];
+    uint32_t state; // RAY_* bits, then the panel index + 1 (0 for no panel)
+public:
+    RayRecord() {}
+    RayRecord(const Ray& ray, int panel);
+    bool getPanelled() const;
+    bool getReflected() const;
+    bool getCollectored() const;
+    int getPanel() const; // -1 if the ray hit no panel
+    void getSegment(float* segment) const; // Same as Ray::getSegment of the recorded ray
+    void printGnuplot(ostream& file) const;
+};
+
+// Energy tallies of traceBounces. Every path carries an energy of 1 after its first mirror, like a
+// panel hit of the other tracers (the panel power accounts for that reflection); later mirrors keep
+// the reflectivity of the scene. The paths starting on a secondary reflector are tallied apart, since
+// the reflectors are not part of the panel power.
+class BounceCounts {
+public:
+    long rays; // Sun rays traced
+    long reflectorHits; // Sun rays hitting a reflector first; they are not panel hits
+    long reflectorShaded; // Reflector hits hidden behind a nearer mirror
+    long direct; // Sun rays stopped by a receiver before they reach a mirror
+    long backHits; // Paths ending on the back of a mirror
+    long truncated; // Paths still reflecting after the maximum number of bounces
+    double absorbed; // Energy absorbed by the mirrors after the first reflection
+    double lost; // Energy leaving the scene after at least one reflection, truncated paths included
+    vector<long> receiverHits;
+    vector<double> receiverEnergy, receiverEnergySq; // Sums of the energy (and its square) of the rays each receiver absorbs
+    vector<double> reflectorEnergy, reflectorEnergySq; // The part of receiverEnergy (and receiverEnergySq) from the paths starting on a reflector
+    vector<long> bounceHits; // Receiver hits after 1, 2, ... reflections (index 0 is unused)
+
+    BounceCounts() { reset(0, 0); }
+    void reset(int numOfReceivers, int maxBounces);
+    void add(const BounceCounts& other);
+};
+
+// Result counts of one trace, with optional tallies for each panel
+class TraceCounts {
+public:
+    long hitPanel, missPanel, hitCollector, missCollector;
+    long shaded; // Panel hits hidden behind a nearer panel or reflector; only counted with shading and by traceBounces
+    long blocked; // Reflected rays counted in missCollector because another panel is in their way
+    vector<long> panelHits; // Rays hitting each panel first
+    vector<long> panelCollectorHits; // Rays reflected by each panel into the collector
+    BounceCounts bounces; // Only filled by traceBounces
+    vector<float> panelFractions; // Exact collector fraction of each panel; only filled by traceAnalytic
+
+    TraceCounts() { reset(0); }
+    void reset(int numOfPanels);
+    void add(const TraceCounts& other);
+};
 
-    bool hitsPanel(Panel panel);
-    bool reflect(Panel panel, Ray& reflectedRay);
-    bool hitsCollector(Collector collector);
-    void printGnuplot(ofstream& file);
+// Buffers generateRays and countRays keep from one trace to the next: the sun-plane grid, the
+// footprint mask, the tiles and the rays returned by generateRays. They grow to the size of the grid on
+// the first trace, so tracing the same field again does not allocate; reserve() sizes the ones that do
+// not depend on the field beforehand. Nothing is copied: a copy starts empty, and assigning an arena
+// releases the buffers of the target.
+class RayArena {
+public:
+    struct Storage; // Defined in Ray.cpp
+private:
+    Storage* storage;
+public:
+    RayArena();
+    RayArena(const RayArena& other);
+    RayArena& operator=(const RayArena& other);
+    ~RayArena();
+    Storage& get();
+    // Room for a grid of rows * columns rays, and for all of its rays when they are stored. The tile
+    // buffers depend on where the rays land, so they still grow during the first trace.
+    void reserve(int rows, int columns, bool store);
+    void release(); // Frees every buffer
 };
 
-void printRays(vector<Ray>& missPanel, vector<Ray>& hitPanel, vector<Ray>& missCollector, vector<Ray>& hitCollector);
+// Mirrors and receivers of a multi-bounce trace. The mirrors are the panels followed by the
+// secondary reflectors; receiver 0 is the collector.
+class BounceScene {
+private:
+    vector<Panel> mirrors;
+    PanelBVH bvh;
+    vector<Collector> receivers;
+    int numOfPanels;
+    float reflectivity; // Share of the energy a mirror reflects
+    int maxBounces; // Reflections traced before a path is dropped
+    float top; // Highest point of the mirrors and receivers
+
+    void setTop();
+public:
+    BounceScene(); // Empty
+    BounceScene(const vector<Panel>& panels, const vector<Panel>& reflectors, const Collector& collector, const vector<Collector>& receivers, float reflectivity, int maxBounces);
+    void aim(const vector<Panel>& panels); // Takes the panels after they turned in place; the tree is only refitted
+    void clear();
+    bool empty() const;
+    const vector<Panel>& getMirrors() const;
+    const PanelBVH& getBVH() const;
+    const vector<Collector>& getReceivers() const;
+    int getNumOfPanels() const;
+    float getReflectivity() const;
+    int getMaxBounces() const;
+    float getTop() const;
+};
+
+void printRays(const vector<RayRecord>& missPanel, const vector<RayRecord>& hitPanel, const vector<RayRecord>& missCollector, const vector<RayRecord>& hitCollector);
+
+// Array of Panels. When bvh is NULL every ray is tested against every panel.
+// The grid is traced in tiles on numThreads threads (0 uses every hardware thread); the
+// output vectors are always in the same order as a single threaded run. sampling places
+// the n * n rays of the sun plane (the regular grid by default). With shading each ray hits the
+// nearest panel along it, and reflected rays blocked by another panel are counted as collector misses.
+// The rays are kept as RayRecords. Returns every ray of the grid; they are kept in the arena (one per
+// thread when none is given) until its next trace.
+const vector<RayRecord>& generateRays(int n, const Point& min, const Point& max, const Sun& sun, const Collector& collector, const vector<Panel>& panels, vector<RayRecord>& hitPanel, vector<RayRecord>& missPanel, vector<RayRecord>& hitCollector, vector<RayRecord>& missCollector, float collectorHeight, const PanelBVH* bvh = NULL, int numThreads = 1, TraceCounts* counts = NULL, const SamplingOptions& sampling = SamplingOptions(), bool shading = false, RayArena* arena = NULL);
+
+// Traces exactly the rays of generateRays but only counts the results. Memory does not grow with n.
+void countRays(int n, const Point& min, const Point& max, const Sun& sun, const Collector& collector, const vector<Panel>& panels, TraceCounts& counts, float collectorHeight, const PanelBVH* bvh = NULL, int numThreads = 1, const SamplingOptions& sampling = SamplingOptions(), bool shading = false, RayArena* arena = NULL);
+
+// Traces a beam of n * n sun rays over the aperture of every panel instead of a grid over the field.
+// The rays start on the panel (no panel search) and the beams are traced in parallel over the panels;
+// panelHits and panelCollectorHits of counts give the collector hit fraction of each panel. Rays are
+// only kept when the three vectors are given. With shading, rays shaded on their way to the panel or
+// blocked on their way to the collector by another panel are counted as collector misses.
+void traceBeams(int n, const Sun& sun, const Collector& collector, const vector<Panel>& panels, TraceCounts& counts, float collectorHeight, int numThreads = 1, const SamplingOptions& sampling = SamplingOptions(), vector<RayRecord>* hitPanel = NULL, vector<RayRecord>* hitCollector = NULL, vector<RayRecord>* missCollector = NULL, const PanelBVH* bvh = NULL, bool shading = false);
 
-// Array of Panels
-vector<Ray> generateRays(int n, Point min, Point max, Sun sun, Collector collector, vector<Panel> panels, vector<Ray>& hitPanel, vector<Ray>& missPanel, vector<Ray>& hitCollector, vector<Ray>& missCollector, float collectorHeight);
+// Traces the n * n sun-plane rays of generateRays through any number of reflections, up to the
+// maximum of the scene, with the energy of a ray scaled by the reflectivity at every mirror. Each path
+// is followed in a loop, and the grid is kept in the arena like countRays, so tracing the same scene
+// again does not allocate. counts get the usual single-bounce view of the paths starting on a panel
+// (hitCollector are the rays that end in receiver 0 after a reflection) and the energy tallies in
+// counts.bounces. The rays are not kept.
+void traceBounces(int n, const Point& min, const Point& max, const Sun& sun, const BounceScene& scene, TraceCounts& counts, float collectorHeight, int numThreads = 1, const SamplingOptions& sampling = SamplingOptions(), RayArena* arena = NULL);
 
 #endif
\ No newline at end of file
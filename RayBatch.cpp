@@ -0,0 +1,232 @@
+#ifndef RayBatch_cpp
+#define RayBatch_cpp
+
+#include <float.h>
+#include "RayBatch.h"
+
+// ** RayBatch Class **
+RayBatch::RayBatch() {}
+void RayBatch::clear() {
+    px.clear(); py.clear(); pz.clear();
+    dx.clear(); dy.clear(); dz.clear();
+}
+void RayBatch::reserve(int n) {
+    px.reserve(n); py.reserve(n); pz.reserve(n);
+    dx.reserve(n); dy.reserve(n); dz.reserve(n);
+}
+void RayBatch::push(const Vector& point, const Vector& direction) {
+    px.push_back(point.getX());
+    py.push_back(point.getY());
+    pz.push_back(point.getZ());
+    dx.push_back(direction.getX());
+    dy.push_back(direction.getY());
+    dz.push_back(direction.getZ());
+}
+int RayBatch::size() const {
+    return px.size();
+}
+const float* RayBatch::getPointX() const { return px.data(); }
+const float* RayBatch::getPointY() const { return py.data(); }
+const float* RayBatch::getPointZ() const { return pz.data(); }
+const float* RayBatch::getDirectionX() const { return dx.data(); }
+const float* RayBatch::getDirectionY() const { return dy.data(); }
+const float* RayBatch::getDirectionZ() const { return dz.data(); }
+
+// ** Kernels **
+
+// The ray's vector points along -direction for rays built by Ray(center, point), so n.v < 0 is n.direction > 0
+static inline bool intersectPanelScalar(float px, float py, float pz, float dx, float dy, float dz, float a, float b, float c, float d, float nx, float ny, float nz, float minX, float maxX, float minY, float maxY) {
+    float t = (d - a * px - b * py - c * pz) / (a * dx + b * dy + c * dz);
+    float x = px + t * dx;
+    float y = py + t * dy;
+    return x <= maxX && x >= minX && y <= maxY && y >= minY && nx * dx + ny * dy + nz * dz > 0;
+}
+
+void intersectPanel(const RayBatch& rays, const Panel& panel, unsigned char* hits) {
+    const float* px = rays.getPointX(); const float* py = rays.getPointY(); const float* pz = rays.getPointZ();
+    const float* dx = rays.getDirectionX(); const float* dy = rays.getDirectionY(); const float* dz = rays.getDirectionZ();
+    const Plane& plane = panel.getPlane();
+    const Vector& normal = panel.getNormal();
+    float a = plane.geta(), b = plane.getb(), c = plane.getc(), d = plane.getd();
+    float nx = normal.getX(), ny = normal.getY(), nz = normal.getZ();
+    float minX = panel.getMinX(), maxX = panel.getMaxX(), minY = panel.getMinY(), maxY = panel.getMaxY();
+
+    int n = rays.size();
+    int i = 0;
+#if defined(__AVX__)
+    __m256 va = _mm256_set1_ps(a), vb = _mm256_set1_ps(b), vc = _mm256_set1_ps(c), vd = _mm256_set1_ps(d);
+    __m256 vnx = _mm256_set1_ps(nx), vny = _mm256_set1_ps(ny), vnz = _mm256_set1_ps(nz);
+    __m256 vMinX = _mm256_set1_ps(minX), vMaxX = _mm256_set1_ps(maxX), vMinY = _mm256_set1_ps(minY), vMaxY = _mm256_set1_ps(maxY);
+    __m256 zero = _mm256_setzero_ps();
+    for (; i + 8 <= n; i += 8) {
+        __m256 vpx = _mm256_loadu_ps(px + i), vpy = _mm256_loadu_ps(py + i), vpz = _mm256_loadu_ps(pz + i);
+        __m256 vdx = _mm256_loadu_ps(dx + i), vdy = _mm256_loadu_ps(dy + i), vdz = _mm256_loadu_ps(dz + i);
+        __m256 num = _mm256_sub_ps(_mm256_sub_ps(_mm256_sub_ps(vd, _mm256_mul_ps(va, vpx)), _mm256_mul_ps(vb, vpy)), _mm256_mul_ps(vc, vpz));
+        __m256 den = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(va, vdx), _mm256_mul_ps(vb, vdy)), _mm256_mul_ps(vc, vdz));
+        __m256 t = _mm256_div_ps(num, den);
+        __m256 x = _mm256_add_ps(vpx, _mm256_mul_ps(t, vdx));
+        __m256 y = _mm256_add_ps(vpy, _mm256_mul_ps(t, vdy));
+        __m256 inside = _mm256_and_ps(_mm256_and_ps(_mm256_cmp_ps(x, vMaxX, _CMP_LE_OQ), _mm256_cmp_ps(x, vMinX, _CMP_GE_OQ)),
+            _mm256_and_ps(_mm256_cmp_ps(y, vMaxY, _CMP_LE_OQ), _mm256_cmp_ps(y, vMinY, _CMP_GE_OQ)));
+        __m256 facing = _mm256_cmp_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(vnx, vdx), _mm256_mul_ps(vny, vdy)), _mm256_mul_ps(vnz, vdz)), zero, _CMP_GT_OQ);
+        int mask = _mm256_movemask_ps(_mm256_and_ps(inside, facing));
+        for (int k = 0; k < 8; k++) {
+            hits[i + k] = (mask >> k) & 1;
+        }
+    }
+#elif defined(__SSE2__)
+    __m128 va = _mm_set1_ps(a), vb = _mm_set1_ps(b), vc = _mm_set1_ps(c), vd = _mm_set1_ps(d);
+    __m128 vnx = _mm_set1_ps(nx), vny = _mm_set1_ps(ny), vnz = _mm_set1_ps(nz);
+    __m128 vMinX = _mm_set1_ps(minX), vMaxX = _mm_set1_ps(maxX), vMinY = _mm_set1_ps(minY), vMaxY = _mm_set1_ps(maxY);
+    __m128 zero = _mm_setzero_ps();
+    for (; i + 4 <= n; i += 4) {
+        __m128 vpx = _mm_loadu_ps(px + i), vpy = _mm_loadu_ps(py + i), vpz = _mm_loadu_ps(pz + i);
+        __m128 vdx = _mm_loadu_ps(dx + i), vdy = _mm_loadu_ps(dy + i), vdz = _mm_loadu_ps(dz + i);
+        __m128 num = _mm_sub_ps(_mm_sub_ps(_mm_sub_ps(vd, _mm_mul_ps(va, vpx)), _mm_mul_ps(vb, vpy)), _mm_mul_ps(vc, vpz));
+        __m128 den = _mm_add_ps(_mm_add_ps(_mm_mul_ps(va, vdx), _mm_mul_ps(vb, vdy)), _mm_mul_ps(vc, vdz));
+        __m128 t = _mm_div_ps(num, den);
+        __m128 x = _mm_add_ps(vpx, _mm_mul_ps(t, vdx));
+        __m128 y = _mm_add_ps(vpy, _mm_mul_ps(t, vdy));
+        __m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmple_ps(x, vMaxX), _mm_cmpge_ps(x, vMinX)),
+            _mm_and_ps(_mm_cmple_ps(y, vMaxY), _mm_cmpge_ps(y, vMinY)));
+        __m128 facing = _mm_cmpgt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(vnx, vdx), _mm_mul_ps(vny, vdy)), _mm_mul_ps(vnz, vdz)), zero);
+        int mask = _mm_movemask_ps(_mm_and_ps(inside, facing));
+        for (int k = 0; k < 4; k++) {
+            hits[i + k] = (mask >> k) & 1;
+        }
+    }
+#endif
+    for (; i < n; i++) {
+        hits[i] = intersectPanelScalar(px[i], py[i], pz[i], dx[i], dy[i], dz[i], a, b, c, d, nx, ny, nz, minX, maxX, minY, maxY);
+    }
+}
+
+static inline bool intersectCollectorScalar(float px, float py, float pz, float dx, float dy, float dz, const float* boxMin, const float* boxMax, BoxCrossing& crossing) {
+    float p[3] = { px, py, pz };
+    float d[3] = { dx, dy, dz };
+    crossing.tEnter = -FLT_MAX;
+    crossing.tExit = FLT_MAX;
+    crossing.enterFace = crossing.exitFace = -1;
+    for (int k = 0; k < 3; k++) {
+        float tNear = (boxMin[k] - p[k]) / d[k], tFar = (boxMax[k] - p[k]) / d[k];
+        int nearFace = 2 * k, farFace = 2 * k + 1;
+        if (tNear > tFar) {
+            float temp = tNear; tNear = tFar; tFar = temp;
+            nearFace = 2 * k + 1; farFace = 2 * k;
+        }
+        // A NaN (a line in the plane of a face) fails both tests and leaves the slab to the other axes
+        if (tNear > crossing.tEnter) {
+            crossing.tEnter = tNear;
+            crossing.enterFace = nearFace;
+        }
+        if (tFar < crossing.tExit) {
+            crossing.tExit = tFar;
+            crossing.exitFace = farFace;
+        }
+    }
+    if (crossing.enterFace < 0 || crossing.exitFace < 0 || crossing.tEnter > crossing.tExit) {
+        crossing.enterFace = crossing.exitFace = -1;
+        return false;
+    }
+    return true;
+}
+
+#if !defined(__AVX__) && defined(__SSE2__)
+// Lanes of b where mask is set, of a elsewhere
+static inline __m128 blend(__m128 a, __m128 b, __m128 mask) {
+    return _mm_or_ps(_mm_andnot_ps(mask, a), _mm_and_ps(mask, b));
+}
+#endif
+
+static void getCollectorBox(const Collector& collector, float* boxMin, float* boxMax) {
+    boxMin[0] = collector.getMinX().getd(); boxMin[1] = collector.getMinY().getd(); boxMin[2] = collector.getMinZ().getd();
+    boxMax[0] = collector.getMaxX().getd(); boxMax[1] = collector.getMaxY().getd(); boxMax[2] = collector.getMaxZ().getd();
+}
+
+bool intersectCollector(const Vector& point, const Vector& direction, const Collector& collector, BoxCrossing& crossing) {
+    float boxMin[3], boxMax[3];
+    getCollectorBox(collector, boxMin, boxMax);
+    return intersectCollectorScalar(point.getX(), point.getY(), point.getZ(), direction.getX(), direction.getY(), direction.getZ(), boxMin, boxMax, crossing);
+}
+
+void intersectCollector(const RayBatch& rays, const Collector& collector, BoxCrossing* crossings) {
+    const float* px = rays.getPointX(); const float* py = rays.getPointY(); const float* pz = rays.getPointZ();
+    const float* dx = rays.getDirectionX(); const float* dy = rays.getDirectionY(); const float* dz = rays.getDirectionZ();
+    float boxMin[3], boxMax[3];
+    getCollectorBox(collector, boxMin, boxMax);
+
+    int n = rays.size();
+    int i = 0;
+#if defined(__AVX__)
+    // The lanes make the same comparisons as intersectCollectorScalar; the faces are carried as floats
+    const float* p[3] = { px, py, pz };
+    const float* d[3] = { dx, dy, dz };
+    float tEnter[8], tExit[8], enterFace[8], exitFace[8];
+    for (; i + 8 <= n; i += 8) {
+        __m256 vEnter = _mm256_set1_ps(-FLT_MAX), vExit = _mm256_set1_ps(FLT_MAX);
+        __m256 vEnterFace = _mm256_set1_ps(-1), vExitFace = _mm256_set1_ps(-1);
+        for (int k = 0; k < 3; k++) {
+            __m256 vp = _mm256_loadu_ps(p[k] + i), vd = _mm256_loadu_ps(d[k] + i);
+            __m256 t1 = _mm256_div_ps(_mm256_sub_ps(_mm256_set1_ps(boxMin[k]), vp), vd);
+            __m256 t2 = _mm256_div_ps(_mm256_sub_ps(_mm256_set1_ps(boxMax[k]), vp), vd);
+            __m256 f1 = _mm256_set1_ps(2 * k), f2 = _mm256_set1_ps(2 * k + 1);
+            __m256 swap = _mm256_cmp_ps(t1, t2, _CMP_GT_OQ);
+            __m256 tNear = _mm256_blendv_ps(t1, t2, swap), tFar = _mm256_blendv_ps(t2, t1, swap);
+            __m256 nearFace = _mm256_blendv_ps(f1, f2, swap), farFace = _mm256_blendv_ps(f2, f1, swap);
+            __m256 enters = _mm256_cmp_ps(tNear, vEnter, _CMP_GT_OQ), exits = _mm256_cmp_ps(tFar, vExit, _CMP_LT_OQ);
+            vEnter = _mm256_blendv_ps(vEnter, tNear, enters);
+            vEnterFace = _mm256_blendv_ps(vEnterFace, nearFace, enters);
+            vExit = _mm256_blendv_ps(vExit, tFar, exits);
+            vExitFace = _mm256_blendv_ps(vExitFace, farFace, exits);
+        }
+        _mm256_storeu_ps(tEnter, vEnter); _mm256_storeu_ps(tExit, vExit);
+        _mm256_storeu_ps(enterFace, vEnterFace); _mm256_storeu_ps(exitFace, vExitFace);
+        for (int k = 0; k < 8; k++) {
+            BoxCrossing& crossing = crossings[i + k];
+            bool hit = enterFace[k] >= 0 && exitFace[k] >= 0 && !(tEnter[k] > tExit[k]);
+            crossing.tEnter = tEnter[k];
+            crossing.tExit = tExit[k];
+            crossing.enterFace = hit ? (int)enterFace[k] : -1;
+            crossing.exitFace = hit ? (int)exitFace[k] : -1;
+        }
+    }
+#elif defined(__SSE2__)
+    // Same as the AVX loop on 4 lanes; SSE2 has no blendv, so the lanes are selected with and/andnot/or
+    const float* p[3] = { px, py, pz };
+    const float* d[3] = { dx, dy, dz };
+    float tEnter[4], tExit[4], enterFace[4], exitFace[4];
+    for (; i + 4 <= n; i += 4) {
+        __m128 vEnter = _mm_set1_ps(-FLT_MAX), vExit = _mm_set1_ps(FLT_MAX);
+        __m128 vEnterFace = _mm_set1_ps(-1), vExitFace = _mm_set1_ps(-1);
+        for (int k = 0; k < 3; k++) {
+            __m128 vp = _mm_loadu_ps(p[k] + i), vd = _mm_loadu_ps(d[k] + i);
+            __m128 t1 = _mm_div_ps(_mm_sub_ps(_mm_set1_ps(boxMin[k]), vp), vd);
+            __m128 t2 = _mm_div_ps(_mm_sub_ps(_mm_set1_ps(boxMax[k]), vp), vd);
+            __m128 f1 = _mm_set1_ps(2 * k), f2 = _mm_set1_ps(2 * k + 1);
+            __m128 swap = _mm_cmpgt_ps(t1, t2);
+            __m128 tNear = blend(t1, t2, swap), tFar = blend(t2, t1, swap);
+            __m128 nearFace = blend(f1, f2, swap), farFace = blend(f2, f1, swap);
+            __m128 enters = _mm_cmpgt_ps(tNear, vEnter), exits = _mm_cmplt_ps(tFar, vExit);
+            vEnter = blend(vEnter, tNear, enters);
+            vEnterFace = blend(vEnterFace, nearFace, enters);
+            vExit = blend(vExit, tFar, exits);
+            vExitFace = blend(vExitFace, farFace, exits);
+        }
+        _mm_storeu_ps(tEnter, vEnter); _mm_storeu_ps(tExit, vExit);
+        _mm_storeu_ps(enterFace, vEnterFace); _mm_storeu_ps(exitFace, vExitFace);
+        for (int k = 0; k < 4; k++) {
+            BoxCrossing& crossing = crossings[i + k];
+            bool hit = enterFace[k] >= 0 && exitFace[k] >= 0 && !(tEnter[k] > tExit[k]);
+            crossing.tEnter = tEnter[k];
+            crossing.tExit = tExit[k];
+            crossing.enterFace = hit ? (int)enterFace[k] : -1;
+            crossing.exitFace = hit ? (int)exitFace[k] : -1;
+        }
+    }
+#endif
+    for (; i < n; i++) {
+        intersectCollectorScalar(px[i], py[i], pz[i], dx[i], dy[i], dz[i], boxMin, boxMax, crossings[i]);
+    }
+}
+
+#endif
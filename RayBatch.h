@@ -0,0 +1,67 @@
+#ifndef RayBatch_h
+#define RayBatch_h
+
+#include <vector>
+#include "Components.h" // Also gets Position.h
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define RAY_BATCH_WIDTH 8
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define RAY_BATCH_WIDTH 4
+#else
+#define RAY_BATCH_WIDTH 1
+#endif
+
+using namespace std;
+
+// Structure of arrays of ray lines (point + t * direction), the layout used by the
+// vectorized intersection kernels. Rays are tested RAY_BATCH_WIDTH at a time.
+class RayBatch {
+private:
+    vector<float> px, py, pz;
+    vector<float> dx, dy, dz;
+public:
+    RayBatch();
+    void clear();
+    void reserve(int n);
+    void push(const Vector& point, const Vector& direction);
+    int size() const;
+
+    const float* getPointX() const;
+    const float* getPointY() const;
+    const float* getPointZ() const;
+    const float* getDirectionX() const;
+    const float* getDirectionY() const;
+    const float* getDirectionZ() const;
+};
+
+// Sets hits[i] to 1 for every ray of the batch for which Ray::intersectsPanel(panel) is true,
+// and to 0 otherwise. The arithmetic is the same as getIntersection so both always agree.
+void intersectPanel(const RayBatch& rays, const Panel& panel, unsigned char* hits);
+
+// Faces of the collector box, in the order of the planes of Ray::hitsCollector
+#define FACE_MIN_X 0
+#define FACE_MAX_X 1
+#define FACE_MIN_Y 2
+#define FACE_MAX_Y 3
+#define FACE_MIN_Z 4
+#define FACE_MAX_Z 5
+
+// Where a line point + t * direction crosses a box: it enters through enterFace at t = tEnter and leaves
+// through exitFace at t = tExit. The faces are -1 when the line misses the box.
+struct BoxCrossing {
+    float tEnter, tExit;
+    int enterFace, exitFace;
+};
+
+// Slab test of the (infinite) line against the box of the collector, in one pass over the three axes.
+// The t of a face is computed exactly like getIntersection computes it with the plane of that face.
+// On ties between axes the face of the lowest axis is kept.
+bool intersectCollector(const Vector& point, const Vector& direction, const Collector& collector, BoxCrossing& crossing);
+
+// intersectCollector for every ray of the batch; crossings must hold rays.size() entries
+void intersectCollector(const RayBatch& rays, const Collector& collector, BoxCrossing* crossings);
+
+#endif
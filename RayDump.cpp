@@ -0,0 +1,126 @@
+#ifndef RayDump_cpp
+#define RayDump_cpp
+
+#include <string.h>
+#include "RayDump.h"
+
+static const char rayDumpMagic[8] = { 'C', 'S', 'P', 'R', 'A', 'Y', 'S', '\0' };
+
+// ** RayDump Class **
+void RayDump::clear() {
+    for (int c = 0; c < RAY_DUMP_CATEGORIES; c++) {
+        for (int k = 0; k < RAY_DUMP_COLUMNS; k++) {
+            columns[c][k].clear();
+        }
+    }
+}
+
+void RayDump::add(RayCategory category, const vector<RayRecord>& rays) {
+    vector<float>* cols = columns[category];
+    for (int k = 0; k < RAY_DUMP_COLUMNS; k++) {
+        cols[k].reserve(cols[k].size() + rays.size());
+    }
+    float segment[RAY_DUMP_COLUMNS];
+    for (vector<RayRecord>::const_iterator rayIdx = rays.begin(); rayIdx != rays.end(); rayIdx++) {
+        rayIdx->getSegment(segment);
+        for (int k = 0; k < RAY_DUMP_COLUMNS; k++) {
+            cols[k].push_back(segment[k]);
+        }
+    }
+}
+
+long RayDump::size(RayCategory category) const {
+    return columns[category][0].size();
+}
+
+const float* RayDump::getColumn(RayCategory category, int column) const {
+    return columns[category][column].empty() ? NULL : &columns[category][column][0];
+}
+
+bool RayDump::write(const string& fileName) const {
+    AsyncOfstream file(fileName);
+    uint32_t version = RAY_DUMP_VERSION, categories = RAY_DUMP_CATEGORIES;
+    uint64_t count[RAY_DUMP_CATEGORIES];
+    for (int c = 0; c < RAY_DUMP_CATEGORIES; c++) {
+        count[c] = columns[c][0].size();
+    }
+    file.write(rayDumpMagic, sizeof(rayDumpMagic));
+    file.write((const char*)&version, sizeof(version));
+    file.write((const char*)&categories, sizeof(categories));
+    file.write((const char*)count, sizeof(count));
+    for (int c = 0; c < RAY_DUMP_CATEGORIES; c++) {
+        for (int k = 0; k < RAY_DUMP_COLUMNS && count[c] > 0; k++) {
+            file.write((const char*)&columns[c][k][0], count[c] * sizeof(float));
+        }
+    }
+    return file.wait();
+}
+
+bool RayDump::read(const string& fileName) {
+    clear();
+    waitForOutput(); // The dump may still be queued for the disk
+    ifstream file(fileName.c_str(), ios::binary);
+    char magic[sizeof(rayDumpMagic)];
+    uint32_t version, categories;
+    uint64_t count[RAY_DUMP_CATEGORIES];
+    file.read(magic, sizeof(magic));
+    file.read((char*)&version, sizeof(version));
+    file.read((char*)&categories, sizeof(categories));
+    if (!file || memcmp(magic, rayDumpMagic, sizeof(magic)) != 0 || version != RAY_DUMP_VERSION || categories != RAY_DUMP_CATEGORIES) {
+        return false;
+    }
+    file.read((char*)count, sizeof(count));
+    for (int c = 0; c < RAY_DUMP_CATEGORIES && file; c++) {
+        for (int k = 0; k < RAY_DUMP_COLUMNS && count[c] > 0; k++) {
+            columns[c][k].resize(count[c]);
+            file.read((char*)&columns[c][k][0], count[c] * sizeof(float));
+        }
+    }
+    if (!file) {
+        clear();
+        return false;
+    }
+    return true;
+}
+
+void RayDump::printGnuplot(RayCategory category, ostream& file) const {
+    const vector<float>* cols = columns[category];
+    for (size_t i = 0; i < cols[0].size(); i++) {
+        file << cols[0][i] << " " << cols[1][i] << " " << cols[2][i] << " " << cols[3][i] << " " << cols[4][i] << " " << cols[5][i] << '\n';
+    }
+}
+
+// ** Other Functions **
+const char* getRayCategoryFile(RayCategory category) {
+    switch (category) {
+        case MISS_PANEL_RAYS: return "Data/~miss_panel.txt";
+        case HIT_PANEL_RAYS: return "Data/~hit_panel.txt";
+        case HIT_COLLECTOR_RAYS: return "Data/~hit_collector.txt";
+        default: return "Data/~miss_collector.txt";
+    }
+}
+
+void printRaysBinary(const vector<RayRecord>& missPanel, const vector<RayRecord>& hitPanel, const vector<RayRecord>& missCollector, const vector<RayRecord>& hitCollector, const string& fileName) {
+    RayDump dump;
+    dump.add(MISS_PANEL_RAYS, missPanel);
+    dump.add(HIT_PANEL_RAYS, hitPanel);
+    dump.add(HIT_COLLECTOR_RAYS, hitCollector);
+    dump.add(MISS_COLLECTOR_RAYS, missCollector);
+    if (!dump.write(fileName)) {
+        cerr << "Could not write " << fileName << endl;
+    }
+}
+
+bool convertRayDump(const string& fileName) {
+    RayDump dump;
+    if (!dump.read(fileName)) {
+        return false;
+    }
+    for (int c = 0; c < RAY_DUMP_CATEGORIES; c++) {
+        AsyncOfstream file(getRayCategoryFile((RayCategory)c));
+        dump.printGnuplot((RayCategory)c, file);
+    }
+    return true;
+}
+
+#endif
@@ -0,0 +1,51 @@
+#ifndef RayDump_h
+#define RayDump_h
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <stdint.h>
+#include "Ray.h" // Also gets Position.h, Components.h and AsyncWriter.h
+
+#define RAY_DUMP_FILE "Data/~rays.bin"
+#define RAY_DUMP_VERSION 1
+#define RAY_DUMP_CATEGORIES 4
+#define RAY_DUMP_COLUMNS 6 // x, y, z and the vector dx, dy, dz of Ray::getSegment
+
+using namespace std;
+
+// Categories in the order they are stored; each one is also a gnuplot text file
+enum RayCategory { MISS_PANEL_RAYS, HIT_PANEL_RAYS, HIT_COLLECTOR_RAYS, MISS_COLLECTOR_RAYS };
+
+// Binary dump of the drawn rays. File layout, in native byte order:
+//   char     magic[8]        "CSPRAYS\0"
+//   uint32_t version         RAY_DUMP_VERSION
+//   uint32_t categories      RAY_DUMP_CATEGORIES
+//   uint64_t count[RAY_DUMP_CATEGORIES]
+// followed, category by category, by RAY_DUMP_COLUMNS packed float32 columns of count values.
+class RayDump {
+private:
+    vector<float> columns[RAY_DUMP_CATEGORIES][RAY_DUMP_COLUMNS];
+public:
+    void clear();
+    void add(RayCategory category, const vector<RayRecord>& rays);
+    long size(RayCategory category) const;
+    const float* getColumn(RayCategory category, int column) const;
+
+    bool write(const string& fileName) const; // Waits until the dump is on disk; false if it could not be written
+    bool read(const string& fileName);
+
+    // Writes a category exactly like Ray::printGnuplot writes each of its rays
+    void printGnuplot(RayCategory category, ostream& file) const;
+};
+
+// Gnuplot text file written by printRays for the category
+const char* getRayCategoryFile(RayCategory category);
+
+// Binary counterpart of printRays
+void printRaysBinary(const vector<RayRecord>& missPanel, const vector<RayRecord>& hitPanel, const vector<RayRecord>& missCollector, const vector<RayRecord>& hitCollector, const string& fileName = RAY_DUMP_FILE);
+
+// Writes the gnuplot text files of printRays from a dump. Returns false if the dump cannot be read.
+bool convertRayDump(const string& fileName = RAY_DUMP_FILE);
+
+#endif
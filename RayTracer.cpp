@@ -14,25 +14,34 @@ RayTracer::RayTracer(const float& time, const Point& colLoc, const Point& colDim
     this->panelDist = panelDist;
     this->zInc = zInc;
     init_k = 0;
+    useBVH = PANEL_BVH;
+    numThreads = NUM_THREADS;
+    storeRays = false;
+    rayOutput = RAY_OUTPUT;
+    verbose = true;
+    raysStored = false;
     totalArea = 0;
     flux = 0;
     tempRateAtCollector = 0;
     powerAtCollector = 0;
+    powerErrorAtCollector = 0;
+    sampling.mode = SAMPLING;
+    adaptiveTolerance = ADAPTIVE_TOLERANCE;
+    engine = TRACE_ENGINE;
+    shading = SHADING;
+    beamSize = BEAM_SIZE;
+    maxBounces = MAX_BOUNCES;
+    batchesUsed = 0;
+    sampling.sunAngularRadius = SUN_DISK ? SUN_RADIUS / SUN_DISTANCE : 0;
 }
 
 Sun& RayTracer::getSun() {
     return sun;
 }
 
-void RayTracer::setup(int mode) {
+void RayTracer::setup(int mode, bool printGeometry) {
     //panels.clear();
-
-    ofstream panelFile("Data/~panel_lines.txt");
-    ofstream collectorFile("Data/~collector_lines.txt");
-    ofstream sunFile("Data/~sun_path.txt");
-
-    collector.printGnuplot(collectorFile);
-    sun.printPath(0.5, collector.getCenter().getZ(), sunFile);
+    sunTable.clear();
 
     float k = init_k;
 
@@ -42,7 +51,6 @@ void RayTracer::setup(int mode) {
             theta_inc = (panelDist / r) * PI / 6;
             for (float theta = 0; theta < 2 * PI; theta += theta_inc) {
                 panels.push_back(Panel(Point(r * cos(theta), r * sin(theta), k), sun.getDirection(), collector.getCenter(), panelSize));
-                panels.back().printGnuplot(panelFile);
                 totalArea += pow(panels.back().getLength(), 2);
             }
             k += zInc;
@@ -53,64 +61,505 @@ void RayTracer::setup(int mode) {
         float r = 0.2;
         for (float theta = 0; theta < 2 * PI - 0.5; theta += PI / 4) {
             panels.push_back(Panel(Point(r * cos(theta), r * sin(theta), k), sun.getDirection(), collector.getCenter(), panelSize));
-            panels.back().printGnuplot(panelFile);
             totalArea += pow(panels.back().getLength(), 2);
         }
 
         r = 0.4;
         for (float theta = 0; theta < 2 * PI - 0.1; theta += PI / 8) {
             panels.push_back(Panel(Point(r * cos(theta), r * sin(theta), k), sun.getDirection(), collector.getCenter(), panelSize));
-            panels.back().printGnuplot(panelFile);
             totalArea += pow(panels.back().getLength(), 2);
         }
 
         r = 0.6;
         for (float theta = 0; theta < 2 * PI - 0.1; theta += PI / 12) {
             panels.push_back(Panel(Point(r * cos(theta), r * sin(theta), k), sun.getDirection(), collector.getCenter(), panelSize));
-            panels.back().printGnuplot(panelFile);
             totalArea += pow(panels.back().getLength(), 2.0);
         }
         totalArea *= MIRROR_AREA_FRACTION;
     }
 
+    panelBVH.build(panels);
+    field.assign(panels);
+    buildBounceScene();
+    reserveArena();
+
+    if (printGeometry) {
+        this->printGeometry();
+    }
 }
 
-void RayTracer::generate() {
+void RayTracer::printGeometry() {
+    AsyncOfstream panelFile("Data/~panel_lines.txt");
+    AsyncOfstream collectorFile("Data/~collector_lines.txt");
+    AsyncOfstream sunFile("Data/~sun_path.txt");
+
+    collector.printGnuplot(collectorFile);
+    sun.printPath(0.5, collector.getCenter().getZ(), sunFile);
+    for (vector<Panel>::iterator panelIdx = panels.begin(); panelIdx != panels.end(); panelIdx++) {
+        panelIdx->printGnuplot(panelFile);
+    }
+}
+
+void RayTracer::aim(const Sun& sun) {
+    sunTable.clear();
+    field.aim(sun.getDirection(), collector.getCenter());
+    field.store(panels);
+    panelBVH.refit(panels);
+    if (!bounceScene.empty()) {
+        bounceScene.aim(panels);
+    }
+}
+
+void RayTracer::setVerbose(bool verbose) {
+    this->verbose = verbose;
+}
+
+void RayTracer::setBruteForce(bool bruteForce) {
+    useBVH = !bruteForce;
+}
+
+void RayTracer::setNumOfThreads(int numThreads) {
+    this->numThreads = numThreads;
+}
+
+void RayTracer::setStoreRays(bool storeRays) {
+    this->storeRays = storeRays;
+    reserveArena();
+}
+
+void RayTracer::setSampling(int mode, uint32_t seed) {
+    sunTable.clear();
+    sampling.mode = mode;
+    sampling.seed = seed;
+}
+
+void RayTracer::setSunDisk(bool sunDisk) {
+    sunTable.clear();
+    sampling.sunAngularRadius = sunDisk ? SUN_RADIUS / SUN_DISTANCE : 0;
+}
+
+void RayTracer::setAdaptive(float tolerance) {
+    sunTable.clear();
+    adaptiveTolerance = tolerance;
+}
+
+void RayTracer::setEngine(int engine) {
+    sunTable.clear();
+    this->engine = engine;
+    buildBounceScene();
+}
+
+void RayTracer::setShading(bool shading) {
+    sunTable.clear();
+    this->shading = shading;
+}
+
+void RayTracer::setBeamSize(int beamSize) {
+    sunTable.clear();
+    this->beamSize = beamSize;
+}
+
+void RayTracer::addReflector(const Point& center, const Point& source, const Point& target, float length) {
+    sunTable.clear();
+    Vector toSource(source.getX() - center.getX(), source.getY() - center.getY(), source.getZ() - center.getZ());
+    reflectors.push_back(Panel(center, toSource, target, length));
+    buildBounceScene();
+}
+
+void RayTracer::addReceiver(const Point& location, const Point& dimensions) {
+    sunTable.clear();
+    receivers.push_back(Collector(location, dimensions.getX(), dimensions.getY(), dimensions.getZ()));
+    buildBounceScene();
+}
+
+void RayTracer::setMaxBounces(int maxBounces) {
+    sunTable.clear();
+    this->maxBounces = maxBounces;
+    buildBounceScene();
+}
+
+void RayTracer::buildBounceScene() {
+    if (engine == ENGINE_BOUNCES && !panels.empty()) {
+        bounceScene = BounceScene(panels, reflectors, collector, receivers, MIRROR_RADIATION_FRACTION, maxBounces);
+    }
+    else {
+        bounceScene.clear();
+    }
+}
+
+void RayTracer::setFluxModel(const FluxModel& fluxModel) {
+    sunTable.clear();
+    this->fluxModel = fluxModel;
+}
+
+const FluxModel& RayTracer::getFluxModel() const {
+    return fluxModel;
+}
+
+float RayTracer::calibrateFluxModel(const vector<float>& times) {
+    sunTable.clear(); // The fit compares traces
+    // Reference powers from the current engine
+    vector<float> reference(times.size());
+    float tempRate;
+    for (size_t i = 0; i < times.size(); i++) {
+        generateFixed(Sun(times[i]), reference[i], tempRate);
+    }
+
+    int tracedEngine = engine;
+    engine = ENGINE_FLUX_MODEL;
+    // Mean squared relative error of the model with the spread exp(x)
+    auto getError = [&](double x) {
+        fluxModel.setSpread(exp(x));
+        double error = 0;
+        for (size_t i = 0; i < times.size(); i++) {
+            float power;
+            generateFixed(Sun(times[i]), power, tempRate);
+            double relative = reference[i] != 0 ? (power - reference[i]) / reference[i] : 0;
+            error += relative * relative;
+        }
+        return times.empty() ? 0 : error / times.size();
+    };
+
+    // Golden section search of the spread between FLUX_SPREAD_MIN and FLUX_SPREAD_MAX
+    const double ratio = (sqrt(5.0) - 1) / 2;
+    double lo = log(FLUX_SPREAD_MIN), hi = log(FLUX_SPREAD_MAX);
+    double x1 = hi - ratio * (hi - lo), x2 = lo + ratio * (hi - lo);
+    double f1 = getError(x1), f2 = getError(x2);
+    for (int i = 0; i < FLUX_CALIBRATION_STEPS; i++) {
+        if (f1 < f2) {
+            hi = x2;
+            x2 = x1; f2 = f1;
+            x1 = hi - ratio * (hi - lo);
+            f1 = getError(x1);
+        }
+        else {
+            lo = x1;
+            x1 = x2; f1 = f2;
+            x2 = lo + ratio * (hi - lo);
+            f2 = getError(x2);
+        }
+    }
+    float error = sqrt(getError((lo + hi) / 2));
+    engine = tracedEngine;
+    return error;
+}
+
+void RayTracer::setRayOutput(int format) {
+    rayOutput = format;
+}
+
+void RayTracer::useSunTable(const string& fileName) {
+    uint64_t key = getSunTableKey();
+    if (sunTable.read(fileName, key)) {
+        if (verbose) {
+            cout << "RayTracer::useSunTable() -- Read " << sunTable.size() << " sun directions from " << fileName << endl;
+        }
+        return;
+    }
+    // The nodes are traced concurrently; each trace then runs on its own thread
+    sunTable.build(key, [&](const Vector& direction) {
+        return getCollectorRatio(Sun(NOON, direction));
+    }, numThreads);
+    if (!sunTable.write(fileName)) {
+        cerr << "Could not write " << fileName << endl;
+    }
+    if (verbose) {
+        cout << "RayTracer::useSunTable() -- Traced " << sunTable.size() << " sun directions into " << fileName << endl;
+    }
+}
+
+bool RayTracer::hasSunTable() const {
+    return !sunTable.empty();
+}
+
+void RayTracer::getTraceBounds(Point& min, Point& max) const {
     float max_k = init_k + zInc * ((rMax - rMin) / panelDist);
-    generateRays(N, Point(1.5 * rMax * cos(5 * PI / 4), 1.5 * rMax * sin(5 * PI / 4) * 1.5, init_k), Point(1.5 * rMax * cos(PI / 4), 1.5 * rMax * sin(PI / 4), max_k), sun, collector, panels, hitPanel, missPanel, hitCollector, missCollector, collector.getMaxZ().getd());
+    min = Point(1.5 * rMax * cos(5 * PI / 4), 1.5 * rMax * sin(5 * PI / 4) * 1.5, init_k);
+    max = Point(1.5 * rMax * cos(PI / 4), 1.5 * rMax * sin(PI / 4), max_k);
+}
+
+void RayTracer::reserveArena() {
+    if (panels.empty()) {
+        return;
+    }
+    // buildGrid adds 4 panel lengths on every side of the bounds (the slant of the sun adds a few rows more)
+    Point min, max;
+    getTraceBounds(min, max);
+    float margin = 8 * panels[0].getLength();
+    int rows = N + (int)(margin * N / fabs(max.getX() - min.getX())) + 2;
+    int columns = N + (int)(margin * N / fabs(max.getY() - min.getY())) + 2;
+    arena.reserve(rows, columns, storeRays && engine == ENGINE_GRID);
+}
+
+void RayTracer::trace(bool store) {
+    Point min, max;
+    getTraceBounds(min, max);
+    if (store && engine == ENGINE_PANEL_BEAMS) {
+        missPanel.clear();
+        traceBeams(beamSize, sun, collector, panels, counts, collector.getMaxZ().getd(), numThreads, sampling, &hitPanel, &hitCollector, &missCollector, useBVH ? &panelBVH : NULL, shading);
+        batchesUsed = 1;
+    }
+    else if (store && engine != ENGINE_BOUNCES && engine != ENGINE_ANALYTIC && engine != ENGINE_FLUX_MODEL) { // The multi-bounce paths are never kept, and the analytic engines have no rays
+        generateRays(N, min, max, sun, collector, panels, hitPanel, missPanel, hitCollector, missCollector, collector.getMaxZ().getd(), useBVH ? &panelBVH : NULL, numThreads, &counts, sampling, shading, &arena);
+        batchesUsed = 1;
+    }
+    else {
+        missPanel.clear();
+        hitPanel.clear();
+        missCollector.clear();
+        hitCollector.clear();
+        countTrace(sun, counts, batchesUsed, &arena);
+    }
+    raysStored = store;
+}
+
+void RayTracer::countOnce(const Sun& sun, const SamplingOptions& sampling, TraceCounts& counts, RayArena* arena) const {
+    if (engine == ENGINE_BOUNCES) {
+        Point min, max;
+        getTraceBounds(min, max);
+        traceBounces(N, min, max, sun, bounceScene, counts, collector.getMaxZ().getd(), numThreads, sampling, arena);
+        return;
+    }
+    if (engine == ENGINE_PANEL_BEAMS) {
+        traceBeams(beamSize, sun, collector, panels, counts, collector.getMaxZ().getd(), numThreads, sampling, NULL, NULL, NULL, useBVH ? &panelBVH : NULL, shading);
+        return;
+    }
+    if (engine == ENGINE_ANALYTIC) {
+        traceAnalytic(sun, collector, panels, counts, numThreads);
+        return;
+    }
+    if (engine == ENGINE_FLUX_MODEL) {
+        fluxModel.estimate(sun, collector, panels, counts);
+        return;
+    }
+    Point min, max;
+    getTraceBounds(min, max);
+    countRays(N, min, max, sun, collector, panels, counts, collector.getMaxZ().getd(), useBVH ? &panelBVH : NULL, numThreads, sampling, shading, arena);
+}
+
+void RayTracer::countTrace(const Sun& sun, TraceCounts& counts, int& batches, RayArena* arena) const {
+    if (adaptiveTolerance <= 0 || engine == ENGINE_ANALYTIC || engine == ENGINE_FLUX_MODEL) { // The analytic engines have no noise to reduce
+        countOnce(sun, sampling, counts, arena);
+        batches = 1;
+        return;
+    }
+
+    // Independent batches of rays until the hit fraction is known well enough. The regular
+    // grid would trace the same rays in every batch, so it is jittered instead.
+    SamplingOptions batchSampling = sampling;
+    if (batchSampling.mode == SAMPLE_GRID) {
+        batchSampling.mode = SAMPLE_JITTERED;
+    }
+    TraceCounts batchCounts;
+    counts.reset(panels.size());
+    for (batches = 0; batches < ADAPTIVE_MAX_BATCHES; ) {
+        batchSampling.seed = sampling.seed + batches;
+        countOnce(sun, batchSampling, batchCounts, arena);
+        counts.add(batchCounts);
+        batches++;
+        if (batches >= ADAPTIVE_MIN_BATCHES && hitFractionError(counts.hitCollector, counts.hitPanel) < adaptiveTolerance) {
+            break;
+        }
+    }
+}
+
+void RayTracer::generate() {
+    trace(storeRays && adaptiveTolerance <= 0);
     setPowerData();
 }
 
+void RayTracer::generateFixed(const Sun& sun, float& powerAtCollector, float& tempRateAtCollector) const {
+    TraceCounts counts;
+    generateFixed(sun, powerAtCollector, tempRateAtCollector, counts);
+}
+
+void RayTracer::generateFixed(const Sun& sun, float& powerAtCollector, float& tempRateAtCollector, TraceCounts& counts) const {
+    if (!sunTable.empty()) { // Interpolated instead of traced
+        float flux = getSunFlux(sun);
+        powerAtCollector = sunTable.lookup(sun.getDirection()) * getPanelPower(sun, flux) + getDirectPower(sun, flux);
+        tempRateAtCollector = collector.calcTemperature(powerAtCollector, DENSITY, MASS, SH);
+        return;
+    }
+    int batches;
+    countTrace(sun, counts, batches, NULL);
+    float flux;
+    float powerError;
+    calcPowerData(sun, counts, flux, powerAtCollector, powerError, tempRateAtCollector, false);
+}
+
 void RayTracer::setPowerData() {
-    cout << "RayTracer::setPowerData() -- Sun's direction vector: " << sun.getDirection() << endl;
-    cout << "RayTracer::setPowerData() -- Sun's Normal Angle: " << sun.getNormalAngle() << endl;
+    calcPowerData(sun, counts, flux, powerAtCollector, powerErrorAtCollector, tempRateAtCollector, verbose);
+}
+
+void RayTracer::calcPowerData(const Sun& sun, const TraceCounts& counts, float& flux, float& powerAtCollector, float& powerError, float& tempRateAtCollector, bool verbose) const {
+    if (verbose) {
+        cout << "RayTracer::setPowerData() -- Sun's direction vector: " << sun.getDirection() << endl;
+        cout << "RayTracer::setPowerData() -- Sun's Normal Angle: " << sun.getNormalAngle() << endl;
+    }
     powerAtCollector = 0;
-    flux = K * pow(SUN_TEMP, 4) * pow(SUN_RADIUS / SUN_DISTANCE, 2) * abs(cos(sun.getNormalAngle() * PI / 180)) * RADIATION_FRACTION;
-    for (vector<Panel>::iterator panelIdx = panels.begin(); panelIdx != panels.end(); panelIdx++) {
-        powerAtCollector += flux * (totalArea / panels.size()) * abs(cos(panelIdx->getNormal().getAngle(sun.getDirection()))) * MIRROR_RADIATION_FRACTION;
+    flux = getSunFlux(sun);
+    if (engine == ENGINE_BOUNCES) {
+        powerAtCollector = getBouncePower(sun, flux, counts, 0, &powerError);
     }
-    if (hitPanel.size() != 0) {
-        cout << "RayTracer::setPowerData() -- hitCollector.size()/hitPanel.size() = " << (float)hitCollector.size() / hitPanel.size() << endl;
-        powerAtCollector *= ((float)hitCollector.size() / hitPanel.size());
+    else if (engine == ENGINE_PANEL_BEAMS) {
+        // Every panel is weighted by its own collector hit fraction
+        float variance = 0;
+        for (size_t p = 0; p < panels.size(); p++) {
+            float panelPower = flux * (totalArea / panels.size()) * abs(cos(panels[p].getNormal().getAngle(sun.getDirection()))) * MIRROR_RADIATION_FRACTION;
+            long hits = p < counts.panelHits.size() ? counts.panelHits[p] : 0;
+            if (hits > 0) {
+                float fraction = (float)counts.panelCollectorHits[p] / hits;
+                powerAtCollector += panelPower * fraction;
+                variance += panelPower * panelPower * fraction * (1 - fraction) / hits;
+            }
+        }
+        powerError = CONFIDENCE_Z * sqrt(variance);
+    }
+    else if (engine == ENGINE_ANALYTIC || engine == ENGINE_FLUX_MODEL) {
+        for (size_t p = 0; p < panels.size() && p < counts.panelFractions.size(); p++) {
+            float panelPower = flux * (totalArea / panels.size()) * abs(cos(panels[p].getNormal().getAngle(sun.getDirection()))) * MIRROR_RADIATION_FRACTION;
+            powerAtCollector += panelPower * counts.panelFractions[p];
+        }
+        powerError = 0;
+    }
+    else {
+        powerAtCollector = getPanelPower(sun, flux);
+    }
+    if (engine == ENGINE_PANEL_BEAMS || engine == ENGINE_BOUNCES || engine == ENGINE_ANALYTIC || engine == ENGINE_FLUX_MODEL) {
+        if (verbose && counts.hitPanel != 0) {
+            cout << "RayTracer::setPowerData() -- hitCollector.size()/hitPanel.size() = " << (float)counts.hitCollector / counts.hitPanel << endl;
+        }
+    }
+    else if (counts.hitPanel != 0) {
+        if (verbose) {
+            cout << "RayTracer::setPowerData() -- hitCollector.size()/hitPanel.size() = " << (float)counts.hitCollector / counts.hitPanel << endl;
+        }
+        // The panel power assumes fully lit panels, so the hits hidden by shading count as lost
+        long litHits = counts.hitPanel + counts.shaded;
+        powerError = powerAtCollector * binomialError(counts.hitCollector, litHits);
+        powerAtCollector *= ((float)counts.hitCollector / litHits);
     }
     else {
         powerAtCollector = 0;
+        powerError = 0;
     }
 
     // The sun also hits the collector directly
+    float directPower = getDirectPower(sun, flux);
+    powerAtCollector += directPower;
+    if (verbose) {
+        cout << "RayTracer::setPowerData() -- Direct Power -- " << directPower << endl;
+    }
+
+    tempRateAtCollector = collector.calcTemperature(powerAtCollector, DENSITY, MASS, SH);
+    if (verbose) {
+        cout << "RayTracer::setPowerData() -- powerAtCollector() -- " << powerAtCollector << endl;
+        cout << "RayTracer::setPowerData() -- tempRateAtCollector() -- " << tempRateAtCollector << endl;
+    }
+}
+
+float RayTracer::getSunFlux(const Sun& sun) const {
+    return K * pow(SUN_TEMP, 4) * pow(SUN_RADIUS / SUN_DISTANCE, 2) * abs(cos(sun.getNormalAngle() * PI / 180)) * RADIATION_FRACTION;
+}
+
+float RayTracer::getPanelPower(const Sun& sun, float flux) const {
+    float power = 0;
+    for (vector<Panel>::const_iterator panelIdx = panels.begin(); panelIdx != panels.end(); panelIdx++) {
+        power += flux * (totalArea / panels.size()) * abs(cos(panelIdx->getNormal().getAngle(sun.getDirection()))) * MIRROR_RADIATION_FRACTION;
+    }
+    return power;
+}
+
+float RayTracer::getReflectorPower(const Sun& sun, float flux) const {
+    float power = 0;
+    for (vector<Panel>::const_iterator reflectorIdx = reflectors.begin(); reflectorIdx != reflectors.end(); reflectorIdx++) {
+        power += flux * pow(reflectorIdx->getLength(), 2) * MIRROR_AREA_FRACTION * abs(cos(reflectorIdx->getNormal().getAngle(sun.getDirection()))) * MIRROR_RADIATION_FRACTION;
+    }
+    return power;
+}
+
+float RayTracer::getBouncePower(const Sun& sun, float flux, const TraceCounts& counts, int receiver, float* error) const {
+    // The power of the panels is shared by the panel hits, shaded ones included, as in the single-bounce
+    // tracer; the power of the reflectors by the reflector hits
+    const BounceCounts& bounces = counts.bounces;
+    double power = 0, variance = 0;
+    if (receiver < (int)bounces.receiverEnergy.size()) {
+        long litHits[2] = { counts.hitPanel + counts.shaded, bounces.reflectorHits + bounces.reflectorShaded };
+        double sourcePower[2] = { getPanelPower(sun, flux), getReflectorPower(sun, flux) };
+        double energy[2] = { bounces.receiverEnergy[receiver] - bounces.reflectorEnergy[receiver], bounces.reflectorEnergy[receiver] };
+        double energySq[2] = { bounces.receiverEnergySq[receiver] - bounces.reflectorEnergySq[receiver], bounces.reflectorEnergySq[receiver] };
+        for (int i = 0; i < 2; i++) {
+            if (litHits[i] > 0) {
+                double mean = energy[i] / litHits[i];
+                power += sourcePower[i] * mean;
+                variance += sourcePower[i] * sourcePower[i] * fmax(energySq[i] / litHits[i] - mean * mean, 0) / litHits[i];
+            }
+        }
+    }
+    if (error != NULL) {
+        *error = CONFIDENCE_Z * sqrt(variance);
+    }
+    return power;
+}
+
+float RayTracer::getDirectPower(const Sun& sun, float flux) const {
     float area1 = collector.getLength() * collector.getHeight();
     float area2 = area1;
     float area3 = collector.getLength() * collector.getWidth();
     float directPower1 = area1 * flux * abs(cos(Vector(1, 0, 0).getAngle(sun.getDirection())));
     float directPower2 = area2 * flux * abs(cos(Vector(0, 1, 0).getAngle(sun.getDirection())));
     float directPower3 = area3 * flux * abs(cos(Vector(0, 0, 1).getAngle(sun.getDirection())));
-    float directPower = directPower1 + directPower2 + directPower3;
-    powerAtCollector += directPower;
-    cout << "RayTracer::setPowerData() -- Direct Power -- " << directPower << endl;
+    return directPower1 + directPower2 + directPower3;
+}
 
-    cout << "RayTracer::setPowerData() -- powerAtCollector() -- " << powerAtCollector << endl;
-    tempRateAtCollector = collector.calcTemperature(powerAtCollector, DENSITY, MASS, SH);
-    cout << "RayTracer::setPowerData() -- tempRateAtCollector() -- " << tempRateAtCollector << endl;
+// For ENGINE_GRID this is hitCollector / (hitPanel + shaded); the other engines weight the panels
+// themselves. Both the reflected power and getPanelPower scale with the flux, so the ratio only depends
+// on the direction of the sun.
+float RayTracer::getCollectorRatio(const Sun& sun) const {
+    if (!(sun.getDirection().getZ() > 0)) {
+        return 0; // The sun is on the horizon; no grid of rays can reach the field
+    }
+    TraceCounts counts;
+    int batches;
+    countTrace(sun, counts, batches, NULL);
+    float flux, power, powerError, tempRate;
+    calcPowerData(sun, counts, flux, power, powerError, tempRate, false);
+    float panelPower = getPanelPower(sun, flux);
+    return panelPower > 0 ? (power - getDirectPower(sun, flux)) / panelPower : 0;
+}
+
+// Panels and reflectors hash their center, normal and bounds; the collector and receivers their box
+static uint64_t hashPanels(const vector<Panel>& panels, uint64_t hash) {
+    for (vector<Panel>::const_iterator panelIdx = panels.begin(); panelIdx != panels.end(); panelIdx++) {
+        const Point& center = panelIdx->getCenter();
+        const Vector& normal = panelIdx->getNormal();
+        float values[] = { center.getX(), center.getY(), center.getZ(), normal.getX(), normal.getY(), normal.getZ(),
+            panelIdx->getMinX(), panelIdx->getMaxX(), panelIdx->getMinY(), panelIdx->getMaxY(), panelIdx->getLength() };
+        hash = hashBytes(values, sizeof(values), hash);
+    }
+    return hash;
+}
+static uint64_t hashCollector(const Collector& collector, uint64_t hash) {
+    const Point& center = collector.getCenter();
+    float values[] = { center.getX(), center.getY(), center.getZ(), collector.getLength(), collector.getWidth(), collector.getHeight() };
+    return hashBytes(values, sizeof(values), hash);
+}
+
+uint64_t RayTracer::getSunTableKey() const {
+    int settings[] = { SUN_TABLE_VERSION, N, engine, beamSize, maxBounces, shading, sampling.mode, (int)sampling.seed };
+    Point min, max;
+    getTraceBounds(min, max);
+    float values[] = { sampling.sunAngularRadius, adaptiveTolerance, fluxModel.getSunSigma(), fluxModel.getSlopeError(), fluxModel.getSpread(),
+        totalArea, min.getX(), min.getY(), min.getZ(), max.getX(), max.getY(), max.getZ() };
+    uint64_t hash = hashBytes(settings, sizeof(settings));
+    hash = hashBytes(values, sizeof(values), hash);
+    hash = hashPanels(panels, hash);
+    hash = hashPanels(reflectors, hash);
+    hash = hashCollector(collector, hash);
+    for (vector<Collector>::const_iterator receiverIdx = receivers.begin(); receiverIdx != receivers.end(); receiverIdx++) {
+        hash = hashCollector(*receiverIdx, hash);
+    }
+    return hash;
 }
 
 // Only works when the panels are setup for the time at which this function is called
@@ -119,19 +568,35 @@ void RayTracer::setPanelContributions() {
     for (vector<Panel>::iterator panelIdx = panels.begin(); panelIdx != panels.end(); panelIdx++) {
         float panelArea = pow(panelIdx->getLength(), 2.0);
         panelIdx->power() = flux * panelArea * abs(cos(panelIdx->getNormal().getAngle(sun.getDirection())));
+        if (engine == ENGINE_PANEL_BEAMS) { // The share of the panel that reaches the collector
+            int p = panelIdx - panels.begin();
+            panelIdx->power() *= counts.panelHits[p] > 0 ? (float)counts.panelCollectorHits[p] / counts.panelHits[p] : 0;
+        }
+        else if (engine == ENGINE_ANALYTIC || engine == ENGINE_FLUX_MODEL) {
+            int p = panelIdx - panels.begin();
+            panelIdx->power() *= p < (int)counts.panelFractions.size() ? counts.panelFractions[p] : 0;
+        }
         sum += flux * panelArea * abs(cos(panelIdx->getNormal().getAngle(sun.getDirection())));
     }
 }
 
 void RayTracer::visualize() {
-    printRays(missPanel, hitPanel, missCollector, hitCollector);
+    if (!raysStored) {
+        trace(true);
+    }
+    if (rayOutput == RAY_OUTPUT_BINARY) {
+        printRaysBinary(missPanel, hitPanel, missCollector, hitCollector);
+    }
+    else {
+        printRays(missPanel, hitPanel, missCollector, hitCollector);
+    }
 }
 
 void RayTracer::printPanelData() {
-    ofstream panelPower("Data/~ind_panel_power.txt");
+    AsyncOfstream panelPower("Data/~ind_panel_power.txt");
     int count = 0;
     for (vector<Panel>::iterator panelIdx = panels.begin(); panelIdx != panels.end(); panelIdx++) {
-        panelPower << "Panel " << ++count << ": " << panelIdx->power() << "W of power contributed." << endl;
+        panelPower << "Panel " << ++count << ": " << panelIdx->power() << "W of power contributed." << '\n';
     }
 }
 
@@ -140,14 +605,22 @@ void RayTracer::eraseRayPowerData() {
     hitPanel.clear();
     missCollector.clear();
     hitCollector.clear();
+    counts.reset(panels.size());
+    raysStored = false;
+    batchesUsed = 0;
 
     flux = 0;
     powerAtCollector = 0;
+    powerErrorAtCollector = 0;
     tempRateAtCollector = 0;
 }
 
 void RayTracer::erasePanelData() {
+    sunTable.clear();
     panels.clear();
+    field.clear();
+    panelBVH.clear();
+    bounceScene.clear();
     totalArea = 0;
 }
 
@@ -155,16 +628,58 @@ int RayTracer::getNumOfPanels() const {
     return panels.size();
 }
 
+long RayTracer::getPanelHits(int panel) const {
+    return panel < (int)counts.panelHits.size() ? counts.panelHits[panel] : 0;
+}
+
+long RayTracer::getPanelCollectorHits(int panel) const {
+    return panel < (int)counts.panelCollectorHits.size() ? counts.panelCollectorHits[panel] : 0;
+}
+
+long RayTracer::getNumOfRays() const {
+    return counts.hitPanel + counts.missPanel;
+}
+
+int RayTracer::getNumOfBatches() const {
+    return batchesUsed;
+}
+
 void RayTracer::info() const {
-    int total = missPanel.size() + hitPanel.size();
+    long total = counts.missPanel + counts.hitPanel;
     cout << panels.size() << " panels generated" << endl;
     cout << total << " rays generated" << endl;
-    cout << hitPanel.size() << " rays hit a panel" << endl;
-    cout << hitCollector.size() << " rays hit the collector" << endl;
-    cout << missCollector.size() << " rays miss the collector" << endl;
+    cout << counts.hitPanel << " rays hit a panel" << endl;
+    cout << counts.hitCollector << " rays hit the collector" << endl;
+    cout << counts.missCollector << " rays miss the collector" << endl;
+    if (shading) {
+        cout << counts.shaded << " panel hits are shaded by a nearer panel" << endl;
+        cout << counts.blocked << " reflected rays are blocked by another panel" << endl;
+    }
     cout << endl;
     cout << "Flux from the sun: " << flux << " W/m^2" << endl;
     cout << "Total power at the collector: " << powerAtCollector << " W" << endl;
+    if (engine == ENGINE_ANALYTIC) {
+        cout << "Collector fractions of the " << counts.panelFractions.size() << " panels computed exactly (no rays)" << endl;
+    }
+    else if (engine == ENGINE_FLUX_MODEL) {
+        cout << "Collector fractions of the " << counts.panelFractions.size() << " panels from the flux model (spread " << fluxModel.getSpread() << ", no rays)" << endl;
+    }
+    if (adaptiveTolerance > 0) {
+        cout << "Adaptive tracing: " << batchesUsed << " batches, standard error of the collector hit fraction " << hitFractionError(counts.hitCollector, counts.hitPanel) << endl;
+    }
+    if (engine == ENGINE_BOUNCES) {
+        const BounceCounts& bounces = counts.bounces;
+        for (size_t r = 0; r < bounces.receiverHits.size(); r++) {
+            cout << "Reflected power at receiver " << r << ": " << getPowerAtReceiver(r) << " W (" << bounces.receiverHits[r] << " rays)" << endl;
+        }
+        for (size_t b = 1; b < bounces.bounceHits.size(); b++) {
+            cout << bounces.bounceHits[b] << " rays reach a receiver after " << b << " reflections" << endl;
+        }
+        cout << bounces.truncated << " paths stopped after " << maxBounces << " reflections, " << bounces.backHits << " on the back of a mirror" << endl;
+    }
+    if (sampling.mode != SAMPLE_GRID || sampling.sunAngularRadius > 0 || adaptiveTolerance > 0 || engine != ENGINE_GRID) {
+        cout << "95% confidence interval of the power: " << powerAtCollector - powerErrorAtCollector << " W to " << powerAtCollector + powerErrorAtCollector << " W" << endl;
+    }
     cout << "Temperature rate at the collector: " << tempRateAtCollector << " K/s" << endl;
 }
 
@@ -172,6 +687,18 @@ float RayTracer::getpowerAtCollector() const {
     return powerAtCollector;
 }
 
+float RayTracer::getPowerErrorAtCollector() const {
+    return powerErrorAtCollector;
+}
+
+int RayTracer::getNumOfReceivers() const {
+    return receivers.size() + 1;
+}
+
+float RayTracer::getPowerAtReceiver(int receiver) const {
+    return getBouncePower(sun, flux, counts, receiver);
+}
+
 float RayTracer::getTempRateAtCollector() const {
     return tempRateAtCollector;
 }
@@ -182,51 +709,107 @@ float getSurroundingTemp(const float& time) {
     return 45;
 }
 
+// Optical steps of printVarSunData and printVarSunDataFixed: every tInc, or with THERMAL_ADAPTIVE every
+// OPTICAL_STEP, since the thermal solver interpolates between them (and holds the last one up to tMax)
+static vector<SweepStep> makeOpticalSteps(float tMin, float tMax, float tInc) {
+    return makeSweepSteps(tMin, tMax, THERMAL_MODE == THERMAL_ADAPTIVE ? fmax(tInc, OPTICAL_STEP) : tInc);
+}
+
+// Writes the power of the optical steps and the temperature every tInc, integrated by a ThermalSolver
+// from temp at tMin
+static void printTemperatures(const vector<SweepStep>& steps, float temp, float k, float tMin, float tMax, float tInc, const Collector& collector, ostream& tempFile, ostream& powerFile, const string& caller) {
+    ThermalSolver solver(collector, DENSITY, MASS, SH, k, getSurroundingTemp);
+    solver.addSamples(steps);
+    vector<SweepStep> outputs = makeSweepSteps(tMin, tMax, tInc);
+    float previous = tMin;
+    for (vector<SweepStep>::iterator output = outputs.begin(); output != outputs.end(); output++) {
+        temp = solver.advance(temp, previous, output->time);
+        previous = output->time;
+        cout << caller << " -- Temperature at time " << output->time << ": " << temp << " deg celsius." << endl;
+        tempFile << output->time << " " << temp << '\n';
+    }
+    for (vector<SweepStep>::const_iterator step = steps.begin(); step != steps.end(); step++) {
+        powerFile << step->time << " " << step->power << '\n';
+    }
+    cout << caller << " -- " << solver.getAcceptedSteps() << " thermal steps (" << solver.getRejectedSteps() << " rejected) over " << steps.size() << " optical steps" << endl;
+}
+
 // Prints temperature and power data from tMin to tMax. tMin must be the time that the concentrated plant is set up. 
 void printVarSunData(const float& tMin, const float& tMax, const float& tInc, const Point& colLoc, const Point& colDim, const int& N, const float& rMin, const float& rMax, const float& panelSize, const float& panelDist, const float& zInc) {
-    ofstream varSunTemp("Data/~var_sun_temp.txt");
-    ofstream varSunPower("Data/~var_sun_power.txt");
+    AsyncOfstream varSunTemp("Data/~var_sun_temp.txt");
+    AsyncOfstream varSunPower("Data/~var_sun_power.txt");
+
+    // Optical power at every time step, traced concurrently
+    vector<SweepStep> steps = makeOpticalSteps(tMin, tMax, tInc);
+    sweepOptical(steps, [&](int i, SweepStep& step) {
+        RayTracer r(step.time, colLoc, colDim, N, rMin, rMax, panelSize, panelDist, zInc);
+        r.setVerbose(false);
+        r.setup(SETUP_MODE, false);
+        r.generate();
+        step.power = r.getpowerAtCollector();
+        step.tempRate = r.getTempRateAtCollector();
+    }, NUM_THREADS);
+    if (!steps.empty()) { // Every step of the serial loop rewrote the geometry; the last one is kept
+        RayTracer r(steps.back().time, colLoc, colDim, N, rMin, rMax, panelSize, panelDist, zInc);
+        r.setup(SETUP_MODE);
+    }
 
+    // Temperature
     float actualTemp = getSurroundingTemp(tMin);
     float previousTemp = getSurroundingTemp(tMin);
     float k = 0.05 / 60;
-    for (float t = tMin; t <= tMax; t += tInc) {
-        RayTracer r(t, colLoc, colDim, N, rMin, rMax, panelSize, panelDist, zInc);
-        r.setup(SETUP_MODE);
-        r.generate();
-        actualTemp += (r.getTempRateAtCollector() - k * (previousTemp + r.getTempRateAtCollector() * (tInc * 3600) - getSurroundingTemp(t))) * (tInc * 3600);
+    if (THERMAL_MODE == THERMAL_ADAPTIVE) {
+        printTemperatures(steps, actualTemp, k, tMin, tMax, tInc, Collector(colLoc, colDim.getX(), colDim.getY(), colDim.getZ()), varSunTemp, varSunPower, "printVarSunData(...)");
+        return;
+    }
+    for (vector<SweepStep>::iterator step = steps.begin(); step != steps.end(); step++) {
+        float t = step->time;
+        actualTemp += (step->tempRate - k * (previousTemp + step->tempRate * (tInc * 3600) - getSurroundingTemp(t))) * (tInc * 3600);
         cout << "printVarSunData(...) -- Temperature at time " << t << ": " << actualTemp << " deg celsius." << endl;
         previousTemp = actualTemp;
-        varSunTemp << t << " " << actualTemp << endl;
-        varSunPower << t << " " << r.getpowerAtCollector() << endl;
+        varSunTemp << t << " " << actualTemp << '\n';
+        varSunPower << t << " " << step->power << '\n';
     }
 }
 
 // Prints temperature and power data from tMin to tMax; the mirrors are adjusted every tInc. tMin must be the time that the concentrated plant is set up. 
 void printVarSunDataIncPolar(float tMin, float tMax, float tInc, float changeInc, const Point& colLoc, const Point& colDim, const int& N, const float& rMin, const float& rMax, const float& panelSize, const float& panelDist, const float& zInc) {
-    ofstream varSunIncPower("Data/~var_sun_inc_power.txt");
+    AsyncOfstream varSunIncPower("Data/~var_sun_inc_power.txt");
 
-    int count = 0;
     int int_changeInc = changeInc / tInc;
+    if (int_changeInc < 1) {
+        int_changeInc = 1;
+    }
 
-    RayTracer r(0, colLoc, colDim, N, rMin, rMax, panelSize, panelDist, zInc);
-    for (float t = tMin; t <= tMax; t += tInc) {
-        cout << "Time: " << t << endl;
-        r.getSun() = Sun(t);
-        if (count++ % int_changeInc == 0) {
-            r.erasePanelData();
-            r.setup(SETUP_MODE);
-        }
-        r.generate();
-        varSunIncPower << t << " " << r.getpowerAtCollector() << endl;
-        r.eraseRayPowerData();
+    // Step i uses the mirrors adjusted at the last step that is a multiple of int_changeInc. The field is
+    // set up once and re-aimed in place for each of those steps; the steps in between share its panels.
+    vector<SweepStep> steps = makeSweepSteps(tMin, tMax, tInc);
+    RayTracer field(tMin, colLoc, colDim, N, rMin, rMax, panelSize, panelDist, zInc);
+    field.setVerbose(false);
+    field.setup(SETUP_MODE, false);
+    for (size_t start = 0; start < steps.size(); start += int_changeInc) {
+        field.aim(Sun(steps[start].time));
+        size_t end = start + int_changeInc < steps.size() ? start + int_changeInc : steps.size();
+        vector<SweepStep> group(steps.begin() + start, steps.begin() + end);
+        sweepOptical(group, [&](int i, SweepStep& step) {
+            field.generateFixed(Sun(step.time), step.power, step.tempRate);
+        }, NUM_THREADS);
+        copy(group.begin(), group.end(), steps.begin() + start);
+    }
+    if (!steps.empty()) {
+        field.printGeometry();
+    }
+
+    for (vector<SweepStep>::iterator step = steps.begin(); step != steps.end(); step++) {
+        cout << "Time: " << step->time << endl;
+        varSunIncPower << step->time << " " << step->power << '\n';
     }
 }
 
 // The mirrors are set up for tMin and no longer adjusted. tMin must be the time the concentrated plant is set up under the sun. This function is used to compare to experimental results. The mirrors are adjusted for a certain time and no longer changed.
 void printVarSunDataFixed(const float& tMin, const float& tMax, const float& tInc, const Point& colLoc, const Point& colDim, const int& N, const float& rMin, const float& rMax, const float& panelSize, const float& panelDist, const float& zInc) {
-    ofstream varSunTempFixed("Data/~var_sun_temp_fixed.txt");
-    ofstream varSunPowerFixed("Data/~var_sun_power_fixed.txt");
+    AsyncOfstream varSunTempFixed("Data/~var_sun_temp_fixed.txt");
+    AsyncOfstream varSunPowerFixed("Data/~var_sun_power_fixed.txt");
 
     float actualTemp = getSurroundingTemp(tMin);
 
@@ -235,31 +818,40 @@ void printVarSunDataFixed(const float& tMin, const float& tMax, const float& tIn
 
     float k = 0.005;
 
-    RayTracer r(tMin, colLoc, colDim, N, rMin, rMax, panelSize, panelDist, zInc);
-    r.setup(SETUP_MODE);
-    cout << "Number of Panels generated for printVarSunDataFixed(...): " << r.getNumOfPanels() << endl;
-
-    int count = 0;
+    RayTracer field(tMin, colLoc, colDim, N, rMin, rMax, panelSize, panelDist, zInc);
+    field.setup(SETUP_MODE);
+    field.setVerbose(false);
+    cout << "Number of Panels generated for printVarSunDataFixed(...): " << field.getNumOfPanels() << endl;
+    if (SUN_TABLE) {
+        field.useSunTable();
+    }
 
+    // Optical power at every time step. The panels and their BVH are shared by all steps; only the sun changes
+    // (or the steps are interpolated in the sun table).
+    vector<SweepStep> steps = makeOpticalSteps(tMin, tMax, tInc);
+    sweepOptical(steps, [&](int i, SweepStep& step) {
+        field.generateFixed(Sun(step.time), step.power, step.tempRate);
+    }, NUM_THREADS);
+
+    // Temperature
+    if (THERMAL_MODE == THERMAL_ADAPTIVE) {
+        printTemperatures(steps, actualTemp, k, tMin, tMax, tInc, Collector(colLoc, colDim.getX(), colDim.getY(), colDim.getZ()), varSunTempFixed, varSunPowerFixed, "printVarSunDataFixed(...)");
+        return;
+    }
     float tempInc = 0;
-    for (float t = tMin; t <= tMax; t += tInc) {
+    for (vector<SweepStep>::iterator step = steps.begin(); step != steps.end(); step++) {
+        float t = step->time;
         cout << "TIME: " << t << endl;
         cout << "Number of minutes passed: " << (t - tMin) * 60 << endl;
-        r.getSun() = Sun(t);
-        r.generate();
-        tempInc = (r.getTempRateAtCollector() - k * (actualTemp + r.getTempRateAtCollector() * (tInc * 3600) - getSurroundingTemp(t))) * (tInc * 3600);
+        tempInc = (step->tempRate - k * (actualTemp + step->tempRate * (tInc * 3600) - getSurroundingTemp(t))) * (tInc * 3600);
         cout << "printVarSunDataFixed(...) -- Delta Temperature (deg C): " << tempInc << endl;
         cout << "printVarSunDataFixed(...) -- Temp Rate (deg C/s): " << tempInc / (tInc * 3600) << endl;
         actualTemp += tempInc;
         cout << "printVarSunDataFixed(...) -- Temperature: " << actualTemp << " deg celsius." << endl;
 
         // printing into the file:
-        varSunTempFixed << t << " " << actualTemp << endl;
-        varSunPowerFixed << t << " " << r.getpowerAtCollector() << endl;
-
-        count++;
-
-        r.eraseRayPowerData();
+        varSunTempFixed << t << " " << actualTemp << '\n';
+        varSunPowerFixed << t << " " << step->power << '\n';
 
         if (tempInc < 0) {
             cout << endl << endl << endl << "************************ MAX REACHED ************************" << endl << endl << endl;
@@ -8,6 +8,13 @@
 #include <string>
 #include <iomanip>
 #include "Ray.h" // Also gets Position.h and Components.h
+#include "RayDump.h"
+#include "Sweep.h"
+#include "HeliostatField.h"
+#include "Analytic.h"
+#include "FluxModel.h"
+#include "SunTable.h"
+#include "ThermalSolver.h"
 
 #define POLAR_INPUTS 13
 #define REC_INPUTS 15
@@ -28,6 +35,37 @@
 
 #define SETUP_MODE 1
 
+#define PANEL_BVH 1 // 0 tests every ray against every panel (used to validate the BVH)
+#define NUM_THREADS 0 // Threads used to trace the rays; 0 uses every hardware thread
+
+#define SAMPLING SAMPLE_GRID // Placement of the sun-plane rays: SAMPLE_GRID, SAMPLE_JITTERED or SAMPLE_HALTON (Sampling.h)
+#define SUN_DISK 0 // 1 spreads the rays over the cone of the sun disk (SUN_RADIUS / SUN_DISTANCE) instead of tracing parallel rays
+#define SHADING 0 // 1 lets panels shade their neighbours and block the reflected rays of their neighbours
+
+#define ENGINE_GRID 0 // One grid of sun rays over the whole field (generateRays)
+#define ENGINE_PANEL_BEAMS 1 // A beam of BEAM_SIZE * BEAM_SIZE rays over every panel (traceBeams)
+#define ENGINE_BOUNCES 2 // The grid of ENGINE_GRID followed through up to MAX_BOUNCES reflections (traceBounces)
+#define ENGINE_ANALYTIC 3 // Exact collector fraction of every panel for parallel sun rays, without rays (traceAnalytic)
+#define ENGINE_FLUX_MODEL 4 // HFLCAL style spot of every panel on the collector, without rays (FluxModel)
+#define TRACE_ENGINE ENGINE_GRID
+#define BEAM_SIZE 16
+#define MAX_BOUNCES 3
+
+#define ADAPTIVE_TOLERANCE 0 // > 0 traces batches of N * N rays until the standard error of hitCollector / hitPanel is below it
+#define ADAPTIVE_MIN_BATCHES 2
+#define ADAPTIVE_MAX_BATCHES 64
+
+#define RAY_OUTPUT_TEXT 0 // visualize() writes the gnuplot text files of printRays
+#define RAY_OUTPUT_BINARY 1 // visualize() writes the binary RAY_DUMP_FILE; convert it with ./raydump
+#define RAY_OUTPUT RAY_OUTPUT_TEXT
+
+#define SUN_TABLE 0 // 1 answers the steps of printVarSunDataFixed from a table of sun directions (useSunTable) instead of tracing each one
+
+#define THERMAL_EULER 0 // printVarSunData and printVarSunDataFixed step the temperature once per optical step (tInc)
+#define THERMAL_ADAPTIVE 1 // The optical steps are OPTICAL_STEP apart and a ThermalSolver gives the temperature every tInc
+#define THERMAL_MODE THERMAL_EULER
+#define OPTICAL_STEP 0.05 // h, spacing of the traced steps with THERMAL_ADAPTIVE (at least tInc)
+
 #define INITIAL_TEMP 39.7
 
 class RayTracer {
@@ -45,31 +83,112 @@ private:
     // Panel/Ray Data:
     float totalArea;
     vector<Panel> panels;
-    vector<Ray> missPanel, hitPanel, missCollector, hitCollector;
+    HeliostatField field; // The panels as arrays, re-aimed by aim()
+    PanelBVH panelBVH;
+    bool useBVH;
+    int numThreads;
+    SamplingOptions sampling;
+    float adaptiveTolerance;
+    int engine;
+    bool shading;
+    int beamSize; // Rays per side of the beam of each panel
+    vector<Panel> reflectors; // Secondary mirrors of ENGINE_BOUNCES
+    vector<Collector> receivers; // Receivers of ENGINE_BOUNCES besides the collector
+    int maxBounces;
+    BounceScene bounceScene; // Mirrors and receivers of ENGINE_BOUNCES; only built for that engine
+    FluxModel fluxModel; // Used by ENGINE_FLUX_MODEL
+    SunTable sunTable; // Collector ratio over sun directions; generateFixed interpolates in it once it is built
+    int batchesUsed; // Batches of N * N rays traced by the last generate()
+    vector<RayRecord> missPanel, hitPanel, missCollector, hitCollector; // Only filled when the rays are stored
+    TraceCounts counts;
+    RayArena arena; // Trace buffers reused by every generate()
+    bool storeRays;
+    bool raysStored;
+    bool verbose;
+    int rayOutput;
+
+    void getTraceBounds(Point& min, Point& max) const; // Corners of the field seen by the sun-plane grid
+    void buildBounceScene(); // Rebuilds bounceScene for ENGINE_BOUNCES, or clears it for the other engines
+    void reserveArena(); // Sizes arena for the grid of getTraceBounds
+    void trace(bool store);
+    // The arena is NULL on the const paths, which may run concurrently; they use the arena of their thread
+    void countOnce(const Sun& sun, const SamplingOptions& sampling, TraceCounts& counts, RayArena* arena) const;
+    void countTrace(const Sun& sun, TraceCounts& counts, int& batches, RayArena* arena) const; // One grid, or batches until adaptiveTolerance is met
+    void calcPowerData(const Sun& sun, const TraceCounts& counts, float& flux, float& powerAtCollector, float& powerError, float& tempRateAtCollector, bool verbose) const;
+    float getSunFlux(const Sun& sun) const;
+    float getPanelPower(const Sun& sun, float flux) const; // Reflected power if every panel were fully lit and reached the collector
+    float getReflectorPower(const Sun& sun, float flux) const; // The same for the secondary reflectors
+    float getBouncePower(const Sun& sun, float flux, const TraceCounts& counts, int receiver, float* error = NULL) const; // Reflected power a receiver gets from traceBounces
+    float getDirectPower(const Sun& sun, float flux) const; // Sunlight falling on the collector itself
+    float getCollectorRatio(const Sun& sun) const; // Share of getPanelPower that the traced field delivers to the collector
+    uint64_t getSunTableKey() const; // Hash of everything getCollectorRatio depends on besides the sun
 
     // Power Data:
     float flux;
     float powerAtCollector;
+    float powerErrorAtCollector; // Half width of the 95% confidence interval of the ray estimate
     float tempRateAtCollector;
 
 public:
     RayTracer(const float& time, const Point& colLoc, const Point& colDim, const int& N, const float& rMin, const float& rMax, const float& panelSize, const float& panelDist, const float& zInc);
     Sun& getSun();
-    void setup(int mode); // Sets up panels using rmin, rmax, panelsSize, zIncrement
+    void setup(int mode, bool printGeometry = true); // Sets up panels using rmin, rmax, panelsSize, zIncrement
+    void printGeometry(); // Writes the panels, collector and sun path for gnuplot
+    void aim(const Sun& sun); // Turns the panels of setup() in place to reflect the given sun onto the collector
+    void setVerbose(bool verbose); // Progress messages of setPowerData()
+    void setBruteForce(bool bruteForce); // Skips the BVH and tests every panel in generate()
+    void setNumOfThreads(int numThreads); // 0 uses every hardware thread
+    void setStoreRays(bool storeRays); // Keeps every traced Ray in generate(); otherwise only counts are kept
+    void setSampling(int mode, uint32_t seed = 1); // SAMPLE_GRID, SAMPLE_JITTERED or SAMPLE_HALTON; the seed picks the random numbers
+    void setSunDisk(bool sunDisk); // Spreads the rays over the sun disk instead of tracing parallel rays
+    void setAdaptive(float tolerance); // 0 traces one grid; otherwise generate() only counts rays and visualize() traces one batch
+    void setEngine(int engine); // ENGINE_GRID, ENGINE_PANEL_BEAMS, ENGINE_BOUNCES, ENGINE_ANALYTIC or ENGINE_FLUX_MODEL (the last three keep no rays for visualize())
+    void setShading(bool shading); // Shading and blocking between panels
+    void setBeamSize(int beamSize);
+    // Secondary mirror of ENGINE_BOUNCES, turned to send the light coming from source to target
+    void addReflector(const Point& center, const Point& source, const Point& target, float length);
+    void addReceiver(const Point& location, const Point& dimensions); // Extra receiver of ENGINE_BOUNCES, sized like the collector
+    void setMaxBounces(int maxBounces);
+    void setFluxModel(const FluxModel& fluxModel);
+    const FluxModel& getFluxModel() const;
+    // Fits the spread of the flux model so ENGINE_FLUX_MODEL gives the power the current engine traces at
+    // the given times (golden section search). The engine is left as it was and the sun table is dropped.
+    // Returns the RMS relative error of the fitted model over those times.
+    float calibrateFluxModel(const vector<float>& times);
+    void setRayOutput(int format); // RAY_OUTPUT_TEXT or RAY_OUTPUT_BINARY, used by visualize()
+    // Traces the collector ratio of the fixed field over the grid of sun directions of SunTable (concurrently),
+    // or reads it from fileName if it was saved there for the same field and settings, and saves it.
+    // generateFixed then interpolates in the table instead of tracing. setup(), aim() and changing the
+    // trace settings drop the table.
+    void useSunTable(const string& fileName = SUN_TABLE_FILE);
+    bool hasSunTable() const;
     void generate(); // Generates rays using on N, panels
+    // Traces the fixed field under another sun without changing the tracer, reusing its panels and BVH.
+    // Gives the power and temperature rate generate() would with that sun; safe to call concurrently.
+    void generateFixed(const Sun& sun, float& powerAtCollector, float& tempRateAtCollector) const;
+    // Same, with the counts of the trace kept by the caller; passing the same counts to every step of a
+    // thread keeps their panel tallies allocated
+    void generateFixed(const Sun& sun, float& powerAtCollector, float& tempRateAtCollector, TraceCounts& counts) const;
     void setPowerData();
     void setPanelContributions();
-    void visualize();
+    void visualize(); // Traces again with storage if generate() only counted the rays
     void printPanelData();
 
     void eraseRayPowerData();
     void erasePanelData();
 
     int getNumOfPanels() const;
+    long getPanelHits(int panel) const;
+    long getPanelCollectorHits(int panel) const;
+    long getNumOfRays() const; // Rays traced by the last generate()
+    int getNumOfBatches() const;
 
     void info() const;
     float getpowerAtCollector() const;
+    float getPowerErrorAtCollector() const;
     float getTempRateAtCollector() const;
+    int getNumOfReceivers() const; // The collector and the receivers added for ENGINE_BOUNCES
+    float getPowerAtReceiver(int receiver) const; // Reflected power reaching a receiver with ENGINE_BOUNCES
 };
 
 float getSurroundingTemp(const float& time);
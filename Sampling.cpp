@@ -0,0 +1,62 @@
+#ifndef Sampling_cpp
+#define Sampling_cpp
+
+#include "Sampling.h"
+
+// ** SamplingOptions Class **
+SamplingOptions::SamplingOptions() {
+    mode = SAMPLE_GRID;
+    seed = 1;
+    sunAngularRadius = 0;
+}
+
+// ** Other Functions **
+float sampleRandom(uint32_t seed, uint64_t index, uint32_t dimension) {
+    // SplitMix64 finalizer of the combined counter
+    uint64_t z = index * 0x9E3779B97F4A7C15ULL + ((uint64_t)seed << 32 | dimension);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    z = z ^ (z >> 31);
+    return (z >> 40) * (1.0f / 16777216.0f); // 24 bits fill the float mantissa
+}
+
+float radicalInverse(uint64_t index, uint32_t base) {
+    double inverseBase = 1.0 / base, digitValue = inverseBase, result = 0;
+    while (index > 0) {
+        result += digitValue * (index % base);
+        index /= base;
+        digitValue *= inverseBase;
+    }
+    return result < 1 ? result : 0.99999994f;
+}
+
+Vector sampleCone(const Vector& direction, float angularRadius, float u1, float u2) {
+    float length = direction.getMag();
+    Vector unit = direction / length;
+
+    // Two unit vectors perpendicular to the direction
+    Vector helper = fabs(unit.getZ()) < 0.9 ? Vector(0, 0, 1) : Vector(1, 0, 0);
+    Vector u(helper.getY() * unit.getZ() - helper.getZ() * unit.getY(), helper.getZ() * unit.getX() - helper.getX() * unit.getZ(), helper.getX() * unit.getY() - helper.getY() * unit.getX());
+    u = u.getUnit();
+    Vector w(unit.getY() * u.getZ() - unit.getZ() * u.getY(), unit.getZ() * u.getX() - unit.getX() * u.getZ(), unit.getX() * u.getY() - unit.getY() * u.getX());
+
+    float angle = angularRadius * sqrt(u1); // Uniform over the disk
+    float phi = 2 * PI * u2;
+    float offset = length * tan(angle);
+    return direction + u * (offset * cos(phi)) + w * (offset * sin(phi));
+}
+
+float binomialError(long hits, long trials) {
+    if (trials <= 0) {
+        return 0;
+    }
+    double p = (double)hits / trials;
+    return CONFIDENCE_Z * sqrt(p * (1 - p) / trials);
+}
+
+float hitFractionError(long hits, long trials) {
+    double p = (hits + 1.0) / (trials + 2.0);
+    return sqrt(p * (1 - p) / (trials + 2.0));
+}
+
+#endif
@@ -0,0 +1,44 @@
+#ifndef Sampling_h
+#define Sampling_h
+
+#include <math.h>
+#include <stdint.h>
+#include "Components.h" // Also gets Position.h
+
+#define SAMPLE_GRID 0     // Regular grid of sun-plane rays (the original generateRays)
+#define SAMPLE_JITTERED 1 // One uniformly placed ray in every cell of the grid
+#define SAMPLE_HALTON 2   // Randomly shifted Halton (2, 3) points over the area of the grid
+
+#define CONFIDENCE_Z 1.96 // Normal quantile of the reported 95% confidence intervals
+
+using namespace std;
+
+// How generateRays places the rays of the sun plane, and how they are aimed
+class SamplingOptions {
+public:
+    int mode;              // SAMPLE_GRID, SAMPLE_JITTERED or SAMPLE_HALTON
+    uint32_t seed;         // Seed of the counter based random numbers; equal seeds trace equal rays
+    float sunAngularRadius; // Half angle (radians) of the sun-disk cone the rays are spread over; 0 traces parallel rays
+
+    SamplingOptions();
+};
+
+// Uniform number in [0, 1) that only depends on (seed, index, dimension), so every
+// thread and tile draws the same value for the same ray.
+float sampleRandom(uint32_t seed, uint64_t index, uint32_t dimension);
+
+// Radical inverse of index in base (2 and 3 give the Halton points)
+float radicalInverse(uint64_t index, uint32_t base);
+
+// Direction inside the cone of half angle angularRadius around direction, uniform over the
+// sun disk. u1 and u2 are uniform numbers in [0, 1).
+Vector sampleCone(const Vector& direction, float angularRadius, float u1, float u2);
+
+// Half width of the confidence interval of a fraction estimated from hits out of trials
+float binomialError(long hits, long trials);
+
+// Standard error of the fraction hits / trials. It uses (hits + 1) / (trials + 2) so that
+// a fraction of exactly 0 or 1 after a few trials is not taken as converged.
+float hitFractionError(long hits, long trials);
+
+#endif
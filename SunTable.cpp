@@ -0,0 +1,139 @@
+#ifndef SunTable_cpp
+#define SunTable_cpp
+
+#include <string.h>
+#include "SunTable.h"
+
+static const char sunTableMagic[8] = { 'C', 'S', 'P', 'S', 'U', 'N', 'T', '\0' };
+
+// Position of value on a grid of count nodes from min to max: the node below it and the weight of the next node
+static void locate(float value, float min, float max, int count, int& node, float& weight) {
+    float u = count > 1 && max > min ? (value - min) / (max - min) * (count - 1) : 0;
+    u = fmin(fmax(u, 0), count - 1);
+    node = count > 1 ? (int)fmin(floor(u), count - 2) : 0;
+    weight = u - node;
+}
+
+// ** SunTable Class **
+SunTable::SunTable() {
+    azimuthMin = SUN_TABLE_AZIMUTH_MIN;
+    azimuthMax = SUN_TABLE_AZIMUTH_MAX;
+    azimuths = SUN_TABLE_AZIMUTHS;
+    elevationMin = SUN_TABLE_ELEVATION_MIN;
+    elevationMax = SUN_TABLE_ELEVATION_MAX;
+    elevations = SUN_TABLE_ELEVATIONS;
+    key = 0;
+}
+
+SunTable::SunTable(float azimuthMin, float azimuthMax, int azimuths, float elevationMin, float elevationMax, int elevations) {
+    this->azimuthMin = azimuthMin;
+    this->azimuthMax = azimuthMax;
+    this->azimuths = azimuths < 1 ? 1 : azimuths;
+    this->elevationMin = elevationMin;
+    this->elevationMax = elevationMax;
+    this->elevations = elevations < 1 ? 1 : elevations;
+    key = 0;
+}
+
+void SunTable::clear() {
+    values.clear();
+    key = 0;
+}
+
+bool SunTable::empty() const {
+    return values.empty();
+}
+
+int SunTable::size() const {
+    return azimuths * elevations;
+}
+
+uint64_t SunTable::getKey() const {
+    return key;
+}
+
+Vector SunTable::getDirection(int node) const {
+    int a = node % azimuths, e = node / azimuths;
+    float azimuth = azimuths > 1 ? azimuthMin + (azimuthMax - azimuthMin) * a / (azimuths - 1) : azimuthMin;
+    float elevation = elevations > 1 ? elevationMin + (elevationMax - elevationMin) * e / (elevations - 1) : elevationMin;
+    azimuth *= PI / 180;
+    elevation *= PI / 180;
+    return Vector(cos(elevation) * cos(azimuth), cos(elevation) * sin(azimuth), sin(elevation));
+}
+
+void SunTable::build(uint64_t key, const function<float(const Vector&)>& value, int numThreads) {
+    values.assign(size(), 0);
+    ThreadPool::shared().parallelFor(size(), [&](int node) {
+        values[node] = value(getDirection(node));
+    }, numThreads);
+    this->key = key;
+}
+
+float SunTable::lookup(const Vector& direction) const {
+    if (values.empty()) {
+        return 0;
+    }
+    float azimuth = atan2(direction.getY(), direction.getX()) * 180 / PI;
+    float elevation = atan2(direction.getZ(), sqrt(direction.getX() * direction.getX() + direction.getY() * direction.getY())) * 180 / PI;
+    int a, e;
+    float wa, we;
+    locate(azimuth, azimuthMin, azimuthMax, azimuths, a, wa);
+    locate(elevation, elevationMin, elevationMax, elevations, e, we);
+    int a1 = a + 1 < azimuths ? a + 1 : a, e1 = e + 1 < elevations ? e + 1 : e;
+    float low = values[e * azimuths + a] * (1 - wa) + values[e * azimuths + a1] * wa;
+    float high = values[e1 * azimuths + a] * (1 - wa) + values[e1 * azimuths + a1] * wa;
+    return low * (1 - we) + high * we;
+}
+
+bool SunTable::write(const string& fileName) const {
+    AsyncOfstream file(fileName);
+    uint32_t version = SUN_TABLE_VERSION, counts[2] = { (uint32_t)azimuths, (uint32_t)elevations };
+    float bounds[4] = { azimuthMin, azimuthMax, elevationMin, elevationMax };
+    file.write(sunTableMagic, sizeof(sunTableMagic));
+    file.write((const char*)&version, sizeof(version));
+    file.write((const char*)counts, sizeof(counts));
+    file.write((const char*)bounds, sizeof(bounds));
+    file.write((const char*)&key, sizeof(key));
+    if (!values.empty()) {
+        file.write((const char*)&values[0], values.size() * sizeof(float));
+    }
+    return file.wait(); // The table is small, and a failure has to be known before it is trusted
+}
+
+bool SunTable::read(const string& fileName, uint64_t key) {
+    clear();
+    waitForOutput(); // The table may still be queued for the disk
+    ifstream file(fileName.c_str(), ios::binary);
+    char magic[sizeof(sunTableMagic)];
+    uint32_t version, counts[2];
+    float bounds[4];
+    uint64_t fileKey;
+    file.read(magic, sizeof(magic));
+    file.read((char*)&version, sizeof(version));
+    file.read((char*)counts, sizeof(counts));
+    file.read((char*)bounds, sizeof(bounds));
+    file.read((char*)&fileKey, sizeof(fileKey));
+    if (!file || memcmp(magic, sunTableMagic, sizeof(magic)) != 0 || version != SUN_TABLE_VERSION || fileKey != key ||
+        (int)counts[0] != azimuths || (int)counts[1] != elevations || bounds[0] != azimuthMin || bounds[1] != azimuthMax || bounds[2] != elevationMin || bounds[3] != elevationMax) {
+        return false;
+    }
+    values.resize(size());
+    file.read((char*)&values[0], values.size() * sizeof(float));
+    if (!file) {
+        clear();
+        return false;
+    }
+    this->key = key;
+    return true;
+}
+
+// ** Other Functions **
+uint64_t hashBytes(const void* data, size_t size, uint64_t hash) {
+    const unsigned char* bytes = (const unsigned char*)data;
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ bytes[i]) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+#endif
@@ -0,0 +1,61 @@
+#ifndef SunTable_h
+#define SunTable_h
+
+#include <vector>
+#include <string>
+#include <functional>
+#include <fstream>
+#include <stdint.h>
+#include "Components.h" // Also gets Position.h
+#include "AsyncWriter.h"
+#include "ThreadPool.h"
+
+#define SUN_TABLE_FILE "Data/~sun_table.bin"
+#define SUN_TABLE_VERSION 1
+#define SUN_TABLE_AZIMUTH_MIN -180 // deg; the sun path of Sun keeps y <= 0
+#define SUN_TABLE_AZIMUTH_MAX 0
+#define SUN_TABLE_AZIMUTHS 121
+#define SUN_TABLE_ELEVATION_MIN 0 // deg
+#define SUN_TABLE_ELEVATION_MAX 60 // The sun of Sun peaks at atan(1.6) = 58 deg
+#define SUN_TABLE_ELEVATIONS 31
+
+using namespace std;
+
+// A value tabulated over a grid of sun directions: azimuth (atan2 of y and x) and elevation above the
+// xy plane, both in degrees, of the direction towards the sun. build() evaluates every node concurrently
+// and lookup() interpolates bilinearly, clamping directions outside the grid to its edges.
+// The key identifies what was tabulated (the field, collector and tracer settings). The file layout, in native byte order:
+//   char     magic[8]        "CSPSUNT\0"
+//   uint32_t version         SUN_TABLE_VERSION
+//   uint32_t azimuths, elevations
+//   float    azimuthMin, azimuthMax, elevationMin, elevationMax
+//   uint64_t key
+// followed by azimuths * elevations float32 values, azimuth fastest.
+class SunTable {
+private:
+    float azimuthMin, azimuthMax, elevationMin, elevationMax;
+    int azimuths, elevations;
+    uint64_t key;
+    vector<float> values; // Empty until built or read
+public:
+    SunTable(); // The SUN_TABLE_* grid
+    SunTable(float azimuthMin, float azimuthMax, int azimuths, float elevationMin, float elevationMax, int elevations);
+    void clear();
+    bool empty() const;
+    int size() const; // Nodes of the grid
+    uint64_t getKey() const;
+
+    Vector getDirection(int node) const; // Unit vector towards the sun at a node
+    // Evaluates value(direction) at every node, using at most numThreads threads (0 uses every hardware thread)
+    void build(uint64_t key, const function<float(const Vector&)>& value, int numThreads = 0);
+    float lookup(const Vector& direction) const;
+
+    bool write(const string& fileName) const;
+    // Reads the table only if it has this grid and key; otherwise returns false and stays empty
+    bool read(const string& fileName, uint64_t key);
+};
+
+// FNV-1a hash of size bytes, continuing from hash; used to build the keys of the tables
+uint64_t hashBytes(const void* data, size_t size, uint64_t hash = 14695981039346656037ULL);
+
+#endif
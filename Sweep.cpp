@@ -0,0 +1,24 @@
+#ifndef Sweep_cpp
+#define Sweep_cpp
+
+#include "Sweep.h"
+
+vector<SweepStep> makeSweepSteps(float tMin, float tMax, float tInc) {
+    vector<SweepStep> steps;
+    for (float t = tMin; t <= tMax; t += tInc) {
+        SweepStep step;
+        step.time = t;
+        step.power = 0;
+        step.tempRate = 0;
+        steps.push_back(step);
+    }
+    return steps;
+}
+
+void sweepOptical(vector<SweepStep>& steps, const function<void(int, SweepStep&)>& traceStep, int numThreads) {
+    ThreadPool::shared().parallelFor(steps.size(), [&](int i) {
+        traceStep(i, steps[i]);
+    }, numThreads);
+}
+
+#endif
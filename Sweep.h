@@ -0,0 +1,25 @@
+#ifndef Sweep_h
+#define Sweep_h
+
+#include <vector>
+#include <functional>
+#include "ThreadPool.h"
+
+using namespace std;
+
+// Optical result of one time step of a sweep
+struct SweepStep {
+    float time;
+    float power;    // RayTracer::getpowerAtCollector()
+    float tempRate; // RayTracer::getTempRateAtCollector()
+};
+
+// Time steps from tMin to tMax, accumulated exactly like the serial `t += tInc` loops
+vector<SweepStep> makeSweepSteps(float tMin, float tMax, float tInc);
+
+// Evaluates traceStep(i, steps[i]) for every step concurrently on the thread pool. The
+// optical steps are independent, so each call must work on its own RayTracer; the
+// results are in time order for the (serial) thermal pass that follows.
+void sweepOptical(vector<SweepStep>& steps, const function<void(int, SweepStep&)>& traceStep, int numThreads = 0);
+
+#endif
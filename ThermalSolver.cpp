@@ -0,0 +1,136 @@
+#ifndef ThermalSolver_cpp
+#define ThermalSolver_cpp
+
+#include <algorithm>
+#include "ThermalSolver.h"
+
+// Dormand-Prince 5(4): nodes, stages, the fifth order weights (also the last stage, so its derivative is
+// reused as the first stage of the next step) and the difference to the fourth order weights
+static const double dpC[7] = { 0, 1.0 / 5, 3.0 / 10, 4.0 / 5, 8.0 / 9, 1, 1 };
+static const double dpA[7][6] = {
+    { 0 },
+    { 1.0 / 5 },
+    { 3.0 / 40, 9.0 / 40 },
+    { 44.0 / 45, -56.0 / 15, 32.0 / 9 },
+    { 19372.0 / 6561, -25360.0 / 2187, 64448.0 / 6561, -212.0 / 729 },
+    { 9017.0 / 3168, -355.0 / 33, 46732.0 / 5247, 49.0 / 176, -5103.0 / 18656 },
+    { 35.0 / 384, 0, 500.0 / 1113, 125.0 / 192, -2187.0 / 6784, 11.0 / 84 }
+};
+static const double dpE[7] = { 71.0 / 57600, 0, -71.0 / 16695, 71.0 / 1920, -17253.0 / 339200, 22.0 / 525, -1.0 / 40 };
+
+// ** ThermalSolver Class **
+ThermalSolver::ThermalSolver(const Collector& collector, float density, float mass, float specificHeat, float k, const function<float(float)>& surroundingTemp) {
+    this->collector = collector;
+    this->density = density;
+    this->mass = mass;
+    this->specificHeat = specificHeat;
+    this->k = k;
+    this->surroundingTemp = surroundingTemp;
+    tolerance = THERMAL_TOLERANCE;
+    minStep = THERMAL_MIN_STEP;
+    maxStep = THERMAL_MAX_STEP;
+    step = THERMAL_FIRST_STEP;
+    accepted = 0;
+    rejected = 0;
+}
+
+void ThermalSolver::setTolerance(double tolerance) {
+    this->tolerance = tolerance;
+}
+
+void ThermalSolver::setStepLimits(double minStep, double maxStep) {
+    this->minStep = minStep;
+    this->maxStep = maxStep;
+}
+
+void ThermalSolver::addSample(float time, float power) {
+    times.push_back(time);
+    powers.push_back(power);
+}
+
+void ThermalSolver::addSamples(const vector<SweepStep>& steps) {
+    for (vector<SweepStep>::const_iterator stepIdx = steps.begin(); stepIdx != steps.end(); stepIdx++) {
+        addSample(stepIdx->time, stepIdx->power);
+    }
+}
+
+float ThermalSolver::getPower(float time) const {
+    if (times.empty()) {
+        return 0;
+    }
+    size_t next = upper_bound(times.begin(), times.end(), time) - times.begin();
+    if (next == 0) {
+        return powers.front();
+    }
+    if (next == times.size()) {
+        return powers.back();
+    }
+    float weight = (time - times[next - 1]) / (times[next] - times[next - 1]);
+    return powers[next - 1] + (powers[next] - powers[next - 1]) * weight;
+}
+
+double ThermalSolver::getDerivative(double seconds, double temp) const {
+    float time = seconds / 3600;
+    return collector.calcTemperature(getPower(time), density, mass, specificHeat) - k * (temp - surroundingTemp(time));
+}
+
+float ThermalSolver::advance(float temp, float tStart, float tEnd) {
+    double t = tStart * 3600.0, end = tEnd * 3600.0;
+    double y = temp;
+    double d[7];
+    d[0] = getDerivative(t, y);
+    while (end - t > 1e-9 * fmax(fabs(end), 1)) {
+        // The interpolated power has a kink at every sample, so a step never crosses one
+        double limit = end;
+        size_t next = lower_bound(times.begin(), times.end(), (float)(t / 3600)) - times.begin();
+        while (next < times.size() && times[next] * 3600.0 <= t) {
+            next++;
+        }
+        if (next < times.size() && times[next] * 3600.0 < end) {
+            limit = times[next] * 3600.0;
+        }
+        double h = fmin(step, limit - t);
+        bool clipped = h < step;
+
+        for (int s = 1; s < 7; s++) {
+            double stage = y;
+            for (int j = 0; j < s; j++) {
+                stage += h * dpA[s][j] * d[j];
+            }
+            d[s] = getDerivative(t + dpC[s] * h, stage);
+        }
+        double next5 = y;
+        double error = 0;
+        for (int j = 0; j < 7; j++) {
+            next5 += j < 6 ? h * dpA[6][j] * d[j] : 0;
+            error += h * dpE[j] * d[j];
+        }
+        error = fabs(error);
+
+        double factor = error > 0 ? 0.9 * pow(tolerance / error, 0.2) : 5;
+        factor = fmin(fmax(factor, 0.2), 5);
+        if (error <= tolerance || h <= minStep) {
+            t = clipped ? limit : t + h;
+            y = next5;
+            d[0] = d[6];
+            accepted++;
+            double grown = fmin(fmax(h * factor, minStep), maxStep);
+            step = clipped ? fmax(step, grown) : grown;
+        }
+        else {
+            rejected++;
+            step = fmin(fmax(h * factor, minStep), maxStep);
+        }
+    }
+    return y;
+}
+
+int ThermalSolver::getAcceptedSteps() const {
+    return accepted;
+}
+
+int ThermalSolver::getRejectedSteps() const {
+    return rejected;
+}
+
+#endif
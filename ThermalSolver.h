@@ -0,0 +1,49 @@
+#ifndef ThermalSolver_h
+#define ThermalSolver_h
+
+#include <vector>
+#include <functional>
+#include "Components.h" // Also gets Position.h
+#include "Sweep.h"
+
+#define THERMAL_TOLERANCE 1e-3 // K, error allowed in one step
+#define THERMAL_MIN_STEP 1e-2 // s
+#define THERMAL_MAX_STEP 600 // s
+#define THERMAL_FIRST_STEP 10 // s
+
+using namespace std;
+
+// Temperature of the collector under Newton's law of cooling, dT/dt = r(t) - k (T - Ts(t)), with t in
+// seconds. r(t) is Collector::calcTemperature of the optical power, interpolated linearly between the
+// samples of the tracer, and Ts is the surrounding temperature. The equation is integrated with the
+// Dormand-Prince 5(4) pair: the step grows and shrinks to keep the local error below the tolerance,
+// independently of the spacing of the optical samples (the steps only stop at the samples, where r(t)
+// has kinks).
+class ThermalSolver {
+private:
+    Collector collector;
+    float density, mass, specificHeat;
+    float k; // 1/s
+    function<float(float)> surroundingTemp; // deg C at a time in hours
+    vector<float> times, powers; // Optical samples: hours, W
+    double tolerance, minStep, maxStep;
+    double step; // Next step to try, carried from one advance() to the next
+    int accepted, rejected;
+
+    double getDerivative(double seconds, double temp) const;
+public:
+    ThermalSolver(const Collector& collector, float density, float mass, float specificHeat, float k, const function<float(float)>& surroundingTemp);
+    void setTolerance(double tolerance);
+    void setStepLimits(double minStep, double maxStep);
+
+    void addSample(float time, float power); // In increasing time
+    void addSamples(const vector<SweepStep>& steps);
+    float getPower(float time) const; // Interpolated between the samples; the first or last one outside them
+
+    // Temperature at tEnd (hours) of the collector at temp at tStart
+    float advance(float temp, float tStart, float tEnd);
+    int getAcceptedSteps() const;
+    int getRejectedSteps() const;
+};
+
+#endif
@@ -0,0 +1,108 @@
+#ifndef ThreadPool_cpp
+#define ThreadPool_cpp
+
+#include "ThreadPool.h"
+
+static thread_local bool insidePool = false;
+
+// ** ThreadPool Class **
+ThreadPool::ThreadPool() {
+    task = NULL;
+    count = 0;
+    next = 0;
+    helpersWanted = 0;
+    helpersActive = 0;
+    generation = 0;
+    stopping = false;
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        lock_guard<mutex> lock(stateMutex);
+        stopping = true;
+    }
+    workAvailable.notify_all();
+    for (size_t i = 0; i < workers.size(); i++) {
+        workers[i].join();
+    }
+}
+
+void ThreadPool::workerLoop() {
+    insidePool = true;
+    unsigned long seen = 0;
+    while (true) {
+        {
+            unique_lock<mutex> lock(stateMutex);
+            workAvailable.wait(lock, [this, seen] { return stopping || (generation != seen && helpersWanted > 0); });
+            if (stopping) {
+                return;
+            }
+            seen = generation;
+            helpersWanted--;
+            helpersActive++;
+        }
+        runTasks();
+        {
+            lock_guard<mutex> lock(stateMutex);
+            helpersActive--;
+        }
+        workDone.notify_all();
+    }
+}
+
+void ThreadPool::runTasks() {
+    for (int i = next++; i < count; i = next++) {
+        (*task)(i);
+    }
+}
+
+void ThreadPool::parallelFor(int count, const function<void(int)>& task, int numThreads) {
+    if (numThreads <= 0) {
+        numThreads = getHardwareThreads();
+    }
+    if (numThreads > count) {
+        numThreads = count;
+    }
+    if (numThreads <= 1 || insidePool) {
+        for (int i = 0; i < count; i++) {
+            task(i);
+        }
+        return;
+    }
+
+    lock_guard<mutex> job(jobMutex);
+    {
+        lock_guard<mutex> lock(stateMutex);
+        while ((int)workers.size() < numThreads - 1) {
+            workers.push_back(thread(&ThreadPool::workerLoop, this));
+        }
+        this->task = &task;
+        this->count = count;
+        next = 0;
+        helpersWanted = numThreads - 1;
+        generation++;
+    }
+    workAvailable.notify_all();
+
+    // The calling thread works on the job as well
+    insidePool = true;
+    runTasks();
+    insidePool = false;
+
+    unique_lock<mutex> lock(stateMutex);
+    helpersWanted = 0; // Workers that have not woken up yet are no longer needed
+    workDone.wait(lock, [this] { return helpersActive == 0; });
+    this->task = NULL;
+}
+
+ThreadPool& ThreadPool::shared() {
+    static ThreadPool pool;
+    return pool;
+}
+
+int ThreadPool::getHardwareThreads() {
+    int threads = thread::hardware_concurrency();
+    return threads > 0 ? threads : 1;
+}
+
+#endif
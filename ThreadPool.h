@@ -0,0 +1,45 @@
+#ifndef ThreadPool_h
+#define ThreadPool_h
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+
+using namespace std;
+
+// A pool of worker threads shared by the whole program. Work is handed out as
+// parallelFor jobs; a parallelFor issued from inside a job runs serially on the
+// calling thread so nested parallel code never oversubscribes the machine.
+class ThreadPool {
+private:
+    vector<thread> workers;
+    mutex jobMutex; // Only one job runs on the pool at a time
+    mutex stateMutex;
+    condition_variable workAvailable, workDone;
+
+    // Current job:
+    const function<void(int)>* task;
+    int count;
+    atomic<int> next;
+    int helpersWanted;
+    int helpersActive;
+    unsigned long generation;
+    bool stopping;
+
+    void workerLoop();
+    void runTasks();
+public:
+    ThreadPool();
+    ~ThreadPool();
+
+    // Calls task(i) for every i in [0, count) using at most numThreads threads (0 uses every hardware thread)
+    void parallelFor(int count, const function<void(int)>& task, int numThreads = 0);
+
+    static ThreadPool& shared();
+    static int getHardwareThreads();
+};
+
+#endif
@@ -0,0 +1,24 @@
+/*
+
+Converts a binary ray dump (RayTracer::setRayOutput(RAY_OUTPUT_BINARY)) into the gnuplot
+text files that printRays writes: Data/~miss_panel.txt, Data/~hit_panel.txt,
+Data/~hit_collector.txt and Data/~miss_collector.txt.
+
+Build and run from the repository root:
+
+make raydump && ./raydump [dump file, Data/~rays.bin by default]
+
+*/
+
+#include "../RayDump.h"
+
+using namespace std;
+
+int main(int argc, char** argv) {
+    string fileName = argc > 1 ? argv[1] : RAY_DUMP_FILE;
+    if (!convertRayDump(fileName)) {
+        cerr << "Could not read the ray dump " << fileName << endl;
+        return 1;
+    }
+    return 0;
+}
@@ -46,6 +46,7 @@ int main() {
 
     RayTracer r(time, colLoc, colDim, N, rMin, rMax, panelSize, panelDist, zInc);
     r.setup(SETUP_MODE);
+    r.setStoreRays(true); // The rays are visualized below
     r.generate();
     r.info(); cout << endl;
     r.visualize();